@@ -9,6 +9,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <time.h>
 #include <sys/times.h>
 #include "clock.h"
 
@@ -277,3 +278,131 @@ double get_comp_counter()
     return ctime;
 }
 
+
+
+/****************************************************************
+ * Serialized counter reads.  rdtsc may be executed before earlier
+ * instructions finish or after later ones start, so on x86 the start
+ * read is fenced on both sides and the end read uses rdtscp, which
+ * waits for the timed code, followed by a fence.  The TSC is used
+ * only if it is invariant, ticking at one rate in every P- and C-state;
+ * otherwise, and off x86, we fall back to CLOCK_MONOTONIC_RAW in
+ * nanoseconds, which NTP does not slew.
+ ****************************************************************/
+
+static unsigned long long mono_ns()
+{
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC_RAW, &t);
+    return (unsigned long long) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+
+static int use_tsc = -1;      /* not yet known */
+static double tsc_hz = 0.0;
+
+/* Use the TSC if it is invariant and rdtscp exists */
+static int tsc_usable()
+{
+    unsigned a, b, c, d;
+
+    if (use_tsc < 0) {
+	use_tsc = __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1 << 8));
+	use_tsc = use_tsc &&
+	    __get_cpuid(0x80000001, &a, &b, &c, &d) && (d & (1 << 27));
+    }
+    return use_tsc;
+}
+
+unsigned long long cycles_begin()
+{
+    unsigned hi, lo;
+
+    if (!tsc_usable())
+	return mono_ns();
+    asm volatile("lfence; rdtsc; lfence"
+		 : "=d" (hi), "=a" (lo)
+		 : /* No input */
+		 : "memory");
+    return ((unsigned long long) hi << 32) | lo;
+}
+
+unsigned long long cycles_end()
+{
+    unsigned hi, lo;
+
+    if (!tsc_usable())
+	return mono_ns();
+    asm volatile("rdtscp; lfence"
+		 : "=d" (hi), "=a" (lo)
+		 : /* No input */
+		 : "%ecx", "memory");
+    return ((unsigned long long) hi << 32) | lo;
+}
+
+/* Count TSC ticks across 50ms of the raw monotonic clock */
+double cycles_hz()
+{
+    unsigned long long t0, t1, c0, c1;
+
+    if (!tsc_usable())
+	return 1e9;
+    if (tsc_hz > 0.0)
+	return tsc_hz;
+    t0 = mono_ns();
+    c0 = cycles_begin();
+    do {
+	t1 = mono_ns();
+    } while (t1 - t0 < 50000000ULL);
+    c1 = cycles_end();
+    tsc_hz = (c1 - c0) * 1e9 / (t1 - t0);
+    return tsc_hz;
+}
+
+char *cycles_source()
+{
+    return tsc_usable() ? "the invariant TSC" : "CLOCK_MONOTONIC_RAW";
+}
+
+#else
+
+unsigned long long cycles_begin()
+{
+    return mono_ns();
+}
+
+unsigned long long cycles_end()
+{
+    return mono_ns();
+}
+
+double cycles_hz()
+{
+    return 1e9;
+}
+
+char *cycles_source()
+{
+    return "CLOCK_MONOTONIC_RAW";
+}
+
+#endif
+
+#define OVHD_TRIALS 10000
+
+unsigned long long cycles_ovhd()
+{
+    unsigned long long t0, t1, least = ~0ULL;
+    int i;
+
+    for (i = 0; i < OVHD_TRIALS; i++) {
+	t0 = cycles_begin();
+	t1 = cycles_end();
+	if (t1 - t0 < least)
+	    least = t1 - t0;
+    }
+    return least;
+}
@@ -20,3 +20,20 @@ double mhz_full(int verbose, int sleeptime);
 void start_comp_counter();
 
 double get_comp_counter();
+
+/** Serialized counter reads for timing a single short call */
+
+/* Read the counter once all earlier instructions have completed */
+unsigned long long cycles_begin();
+
+/* Read the counter before any later instruction starts */
+unsigned long long cycles_end();
+
+/* Counter ticks per second (the TSC rate, else 1e9) */
+double cycles_hz();
+
+/* What the counter reads: an invariant TSC or the raw monotonic clock */
+char *cycles_source();
+
+/* Least cost of an empty cycles_begin/cycles_end pair, in ticks */
+unsigned long long cycles_ovhd();
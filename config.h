@@ -62,11 +62,17 @@
  */
 #define MAX_HEAP (20*(1<<20))  /* 20 MB */
 
+/*
+ * Size in bytes of the address range memlib reserves for mem_map
+ */
+#define MAX_MAP (64*(1<<20))  /* 64 MB */
+
 /*****************************************************************************
  * Set exactly one of these USE_xxx constants to "1" to select a timing method
  *****************************************************************************/
 #define USE_FCYC   0   /* cycle counter w/K-best scheme (x86 & Alpha only) */
 #define USE_ITIMER 0   /* interval timer (any Unix box) */
-#define USE_GETTOD 1   /* gettimeofday (any Unix box) */
+#define USE_GETTOD 0   /* gettimeofday (any Unix box) */
+#define USE_MONO   1   /* invariant TSC or monotonic clock, median of runs */
 
 #endif /* __CONFIG_H */
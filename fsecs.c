@@ -9,6 +9,7 @@
 #include "config.h"
 
 static double Mhz;  /* estimated CPU clock frequency */
+static double spread; /* relative spread of the last fsecs, if known */
 
 extern int verbose; /* -v option in mdriver.c */
 
@@ -36,6 +37,10 @@ void init_fsecs(void)
 #elif USE_GETTOD
     if (verbose)
 	printf("Measuring performance with gettimeofday().\n");
+#elif USE_MONO
+    cycles_hz(); /* calibrate the TSC now rather than in a timed run */
+    if (verbose)
+	printf("Measuring performance with %s.\n", cycles_source());
 #endif
 }
 
@@ -51,7 +56,18 @@ double fsecs(fsecs_test_funct f, void *argp)
     return ftimer_itimer(f, argp, 10);
 #elif USE_GETTOD
     return ftimer_gettod(f, argp, 10);
+#elif USE_MONO
+    return ftimer_mono(f, argp, &spread);
 #endif 
 }
 
+/*
+ * fsecs_spread - Return the spread of the runs behind the last fsecs,
+ * as a fraction of the time it returned, or 0 if the timer keeps none
+ */
+double fsecs_spread(void)
+{
+    return spread;
+}
+
 
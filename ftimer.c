@@ -7,10 +7,14 @@
  * Function timers that estimate the running time (in seconds) of a function f.
  *    ftimer_itimer: version that uses the interval timer
  *    ftimer_gettod: version that uses gettimeofday
+ *    ftimer_mono: version that uses the invariant TSC or the raw
+ *                 monotonic clock, with as many runs as it takes
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <sys/time.h>
 #include "ftimer.h"
+#include "clock.h"
 
 /* function prototypes */
 static void init_etime(void);
@@ -52,6 +56,61 @@ double ftimer_gettod(ftimer_test_funct f, void *argp, int n)
     return (1E-3*diff);
 }
 
+/* Parameters of ftimer_mono */
+#define MONO_BATCH 1e-3    /* a sample times runs for at least this long */
+#define MONO_TARGET 0.05   /* ... and the samples for this long in all */
+#define MONO_MIN 5         /* but take at least MONO_MIN samples */
+#define MONO_MAX 1000      /* ... and at most MONO_MAX */
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/*
+ * ftimer_mono - Use cycles_begin/cycles_end to estimate the running
+ * time of f(argp).  The batch of runs in one sample is doubled until
+ * it lasts MONO_BATCH, so the clock's resolution is lost in it, then
+ * samples are taken until MONO_TARGET has passed.  Return the median
+ * time of one run, and in *spread the interquartile range of the
+ * samples as a fraction of that median.
+ */
+double ftimer_mono(ftimer_test_funct f, void *argp, double *spread)
+{
+    double hz = cycles_hz();
+    double samples[MONO_MAX];
+    double secs, total = 0, median;
+    unsigned long long start;
+    int n = 1, i, k = 0;
+
+    /* Size the batch; this also warms the caches */
+    for (;;) {
+	start = cycles_begin();
+	for (i = 0; i < n; i++)
+	    f(argp);
+	secs = (cycles_end() - start) / hz;
+	if (secs >= MONO_BATCH)
+	    break;
+	n *= 2;
+    }
+
+    while (k < MONO_MAX && (k < MONO_MIN || total < MONO_TARGET)) {
+	start = cycles_begin();
+	for (i = 0; i < n; i++)
+	    f(argp);
+	secs = (cycles_end() - start) / hz;
+	samples[k++] = secs / n;
+	total += secs;
+    }
+
+    qsort(samples, k, sizeof(double), cmp_double);
+    median = (k % 2) ? samples[k / 2] : (samples[k / 2 - 1] + samples[k / 2]) / 2;
+    if (spread != NULL)
+	*spread = (samples[(3 * k) / 4] - samples[k / 4]) / median;
+    return median;
+}
 
 /*
  * Routines for manipulating the Unix interval timer
@@ -12,3 +12,7 @@ double ftimer_itimer(ftimer_test_funct f, void *argp, int n);
    Return the average of n runs */
 double ftimer_gettod(ftimer_test_funct f, void *argp, int n);
 
+/* Estimate the running time of f(argp) using the invariant TSC or the
+   raw monotonic clock, repeating f until the estimate is steady.
+   Return the median run and, in *spread, the relative IQR of the runs */
+double ftimer_mono(ftimer_test_funct f, void *argp, double *spread);
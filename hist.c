@@ -0,0 +1,89 @@
+/*
+ * hist.c - Log-linear latency histograms
+ *
+ * The bucket of v >= HIST_SUB is found from its top HIST_SUB_BITS bits:
+ * with shift chosen so that v >> shift lies in [HIST_SUB / 2, HIST_SUB),
+ * the buckets of the values with that shift follow those of shift - 1.
+ */
+#include <string.h>
+
+#include "hist.h"
+
+/*
+ * hist_bucket - the bucket that counts v
+ */
+static int hist_bucket(uint64_t v)
+{
+	int shift;
+
+	if (v < HIST_SUB)
+		return (int)v;
+	shift = 63 - __builtin_clzll(v) - HIST_SUB_BITS + 1;
+	return (shift << (HIST_SUB_BITS - 1)) + (int)(v >> shift);
+}
+
+/*
+ * hist_highest - the largest value counted by bucket i
+ */
+static uint64_t hist_highest(int i)
+{
+	int shift;
+	uint64_t lo;
+
+	if (i < HIST_SUB)
+		return i;
+	shift = i / (HIST_SUB / 2) - 1;
+	lo = (uint64_t)(i % (HIST_SUB / 2) + HIST_SUB / 2) << shift;
+	return lo + ((uint64_t)1 << shift) - 1;
+}
+
+void hist_reset(hist_t *h)
+{
+	memset(h, 0, sizeof(*h));
+}
+
+void hist_record(hist_t *h, uint64_t v)
+{
+	h->counts[hist_bucket(v)]++;
+	h->count++;
+	if (v > h->max)
+		h->max = v;
+}
+
+/*
+ * hist_add - add the counts of from to those of to
+ */
+void hist_add(hist_t *to, hist_t *from)
+{
+	int i;
+
+	for (i = 0; i < HIST_BUCKETS; i++)
+		to->counts[i] += from->counts[i];
+	to->count += from->count;
+	if (from->max > to->max)
+		to->max = from->max;
+}
+
+/*
+ * hist_percentile - the value that pct percent of those recorded are
+ *     at most, to within the width of its bucket.  Reported as the top
+ *     of the bucket, so it never understates, but never beyond max.
+ */
+uint64_t hist_percentile(hist_t *h, double pct)
+{
+	uint64_t rank, seen = 0;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+	rank = (uint64_t)(pct / 100.0 * h->count + 0.5);
+	if (rank < 1)
+		rank = 1;
+	for (i = 0; i < HIST_BUCKETS; i++)
+	{
+		seen += h->counts[i];
+		if (seen >= rank)
+			return (hist_highest(i) < h->max) ? hist_highest(i) : h->max;
+	}
+	return h->max;
+}
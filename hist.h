@@ -0,0 +1,25 @@
+/*
+ * hist.h - Log-linear latency histograms
+ *
+ * Values below HIST_SUB are counted exactly.  Above that each power of
+ * two is split into HIST_SUB / 2 equal buckets, so a bucket is never
+ * wider than 2 / HIST_SUB of the values in it (about 6%), whatever
+ * their magnitude, in a fixed HIST_BUCKETS counters.
+ */
+#include <stdint.h>
+
+#define HIST_SUB_BITS 5
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) * (HIST_SUB / 2) + HIST_SUB / 2)
+
+typedef struct
+{
+	uint64_t count;				   /* values recorded */
+	uint64_t max;				   /* ... the largest of them, exactly */
+	uint64_t counts[HIST_BUCKETS]; /* values in each bucket */
+} hist_t;
+
+void hist_reset(hist_t *h);
+void hist_record(hist_t *h, uint64_t v);
+void hist_add(hist_t *to, hist_t *from);
+uint64_t hist_percentile(hist_t *h, double pct);
@@ -7,18 +7,31 @@
  * Copyright (c) 2002, R. Bryant and D. O'Hallaron, All rights reserved.
  * May not be used, modified, or copied without permission.
  */
+#define _GNU_SOURCE /* sched_setaffinity */
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdint.h>
 #include <assert.h>
 #include <float.h>
+#include <math.h>
 #include <time.h>
+#include <getopt.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/utsname.h>
 
 #include "mm.h"
 #include "memlib.h"
 #include "fsecs.h"
+#include "clock.h"
+#include "hist.h"
+#include "perfctr.h"
+#include "trace.h"
 #include "config.h"
 
 /**********************
@@ -30,45 +43,53 @@
 #define HDRLINES 4		   /* number of header lines in a trace file */
 #define LINENUM(i) (i + 5) /* cnvt trace request nums to linenums (origin 1) */
 
+/* Changes against a --baseline run that count as regressions */
+#define BASE_THRU_DROP 0.10	 /* throughput down by more than this fraction */
+#define BASE_UTIL_DROP 0.005 /* utilization down by more than this */
+#define BASE_RETIMES 4		 /* extra runs that must confirm a slowdown (even) */
+
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p) ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p) ((((uintptr_t)(p)) % ALIGNMENT) == 0)
 
 /******************************
  * The key compound data types
  *****************************/
 
-/* Records the extent of each block's payload */
+/*
+ * Records the extent of each block's payload.  The records of the live
+ * blocks form an AA tree (a balanced binary search tree) keyed by lo, so
+ * checking a new payload for overlap and removing a freed one take
+ * O(log n) rather than a walk over every live block.
+ */
 typedef struct range_t
 {
-	char *lo;			  /* low payload address */
-	char *hi;			  /* high payload address */
-	struct range_t *next; /* next list element */
+	char *lo;			   /* low payload address */
+	char *hi;			   /* high payload address */
+	struct range_t *left;  /* ranges below lo */
+	struct range_t *right; /* ranges above lo */
+	int level;			   /* AA tree level, 1 at the leaves */
 } range_t;
 
-/* Characterizes a single trace operation (allocator request) */
+/*
+ * In streaming mode (-s) a block is found by its trace index in an
+ * open-addressing hash table that grows and shrinks with the number of
+ * live blocks, rather than in arrays of num_ids entries.
+ */
 typedef struct
 {
-	enum
-	{
-		ALLOC,
-		FREE,
-		REALLOC
-	} type;	   /* type of request */
-	int index; /* index for free() to use later */
-	int size;  /* byte size of alloc/realloc request */
-} traceop_t;
-
-/* Holds the information for one trace file*/
+	uint32_t id; /* trace index of the block */
+	char *block; /* its payload, NULL if the slot is empty */
+	size_t size; /* ... and the payload size */
+} blockent_t;
+
 typedef struct
 {
-	int sugg_heapsize;	 /* suggested heap size (unused) */
-	int num_ids;		 /* number of alloc/realloc ids */
-	int num_ops;		 /* number of distinct requests */
-	int weight;			 /* weight for this trace (unused) */
-	traceop_t *ops;		 /* array of requests */
-	char **blocks;		 /* array of ptrs returned by malloc/realloc... */
-	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
-} trace_t;
+	blockent_t *tab; /* 1 << bits slots, linear probing */
+	int bits;
+	size_t live; /* slots in use */
+} blockmap_t;
+
+#define BLOCKMAP_MIN_BITS 10
 
 /*
  * Holds the params to the xxx_speed functions, which are timed by fcyc.
@@ -81,6 +102,63 @@ typedef struct
 	range_t *ranges;
 } speed_t;
 
+/*
+ * The multithreaded replay (-T).  Each thread replays one trace into
+ * its own blocks array against the one shared package.  Frees it hands
+ * to the next thread go through that thread's xfree ring, a
+ * single-producer single-consumer queue of payload pointers.
+ */
+#define MT_RUNS 3		  /* the best of this many runs is reported */
+#define MT_RING (1 << 12) /* capacity of an xfree ring */
+
+typedef struct mt_thread
+{
+	int id;
+	struct mt_run *run;
+	trace_t *trace; /* shared, read-only */
+	char **blocks;	/* this thread's payload of each trace index */
+	char *xfree[MT_RING];
+	unsigned xfree_head; /* next slot the owner frees */
+	unsigned xfree_tail; /* next slot the producer fills */
+	struct timespec start, end;
+	pthread_t tid;
+} mt_thread_t;
+
+typedef struct mt_run
+{
+	int nthreads;
+	int xfree_pct;	/* percent of trace indices freed by another thread */
+	int active;		/* threads still replaying */
+	pthread_barrier_t barrier;
+	mt_thread_t *threads;
+} mt_run_t;
+
+/*
+ * The latency of each call in an instrumented replay (-L), in counter
+ * ticks less the timer's own cost.  Calls are told apart by type of
+ * request and by the size class of the block they return or free.
+ */
+#define LAT_CLASSES 4
+#define LAT_CLASS(size) ((size) <= 64 ? 0 : (size) <= 1024 ? 1 : (size) <= 16384 ? 2 : 3)
+
+typedef struct
+{
+	hist_t hist[3][LAT_CLASSES]; /* by ALLOC/FREE/REALLOC, then class */
+} latency_t;
+
+/* The percentiles of each type of call kept in stats_t; 100 is the max */
+#define LAT_PCTS 4
+static double lat_pcts[LAT_PCTS] = {50, 99, 99.9, 100};
+
+/* ... and to eval_stream_speed, which reads the trace as it goes */
+typedef struct
+{
+	char *tracedir;
+	char *filename;
+	int reset_heap; /* reset the simulated heap first (not for libc) */
+	int num_ops;	/* set to the number of ops replayed */
+} stream_speed_t;
+
 /* Summarizes the important stats for some malloc function on some trace */
 typedef struct
 {
@@ -88,18 +166,49 @@ typedef struct
 	double ops;	 /* number of ops (malloc/free/realloc) in the trace */
 	int valid;	 /* was the trace processed correctly by the allocator? */
 	double secs; /* number of secs needed to run the trace */
+	double spread; /* ... give or take this fraction of it (if known) */
 
 	/* defined only for the student malloc package */
 	double util; /* space utilization for this trace (always 0 for libc) */
+	size_t peak_heap;  /* largest heap size while running the trace */
+	size_t final_heap; /* heap size once the trace has run */
+	int counted;	   /* were hardware events counted (-P)? */
+	double counts[PERFCTR_EVENTS]; /* ... in one run, -1 if not offered */
+	int timed_calls;   /* were calls timed one by one (-L)? */
+	double latency[3][LAT_PCTS]; /* ... lat_pcts of each type in ns, -1 if none */
 
 	/* Note: secs and util are only defined if valid is true */
 } stats_t;
 
+/* What a -j worker hands back for each of its traces */
+typedef struct
+{
+	stats_t stats;
+	int errors;
+} job_result_t;
+
+/*
+ * One malloc package under test.  The usual build has a single entry
+ * for the package linked in as mm_*.  Built with
+ * -DMM_IMPLS='X(a) X(b) ...', the driver instead runs every package
+ * whose functions were compiled with an a_, b_, ... prefix (see
+ * mdriver-compare in the Makefile).
+ */
+typedef struct
+{
+	char *name;
+	int (*init)(void);
+	void *(*malloc)(size_t size);
+	void (*free)(void *ptr);
+	void *(*realloc)(void *ptr, size_t size);
+} mm_impl_t;
+
 /********************
  * Global variables
  *******************/
 int verbose = 0;	   /* global flag for verbose output */
 static int errors = 0; /* number of errs found when running student malloc */
+static pthread_rwlock_t *timing_lock = NULL; /* timed sections run alone (-j) */
 char msg[MAXLINE];	   /* for whenever we need to compose an error message */
 
 /* Directory where default tracefiles are found */
@@ -109,19 +218,58 @@ static char tracedir[MAXLINE] = TRACEDIR;
 static char *default_tracefiles[] = {
 	DEFAULT_TRACEFILES, NULL};
 
+/* Options with no one-letter form */
+static struct option long_options[] = {
+	{"json", required_argument, NULL, 'J'},
+	{"csv", required_argument, NULL, 'C'},
+	{"baseline", required_argument, NULL, 'B'},
+	{NULL, 0, NULL, 0}};
+
+/* Names of the types of call, by ALLOC/FREE/REALLOC */
+static char *call_names[] = {"malloc", "free", "realloc"};
+
+/* libc, as a package for the streaming replay */
+static int libc_init(void) { return 0; }
+static mm_impl_t libc_impl = {"libc", libc_init, malloc, free, realloc};
+
+/* The malloc packages under test, and the one being evaluated */
+#ifdef MM_IMPLS
+#define X(name)                                       \
+	extern int name##_mm_init(void);                  \
+	extern void *name##_mm_malloc(size_t size);       \
+	extern void name##_mm_free(void *ptr);            \
+	extern void *name##_mm_realloc(void *ptr, size_t size);
+MM_IMPLS
+#undef X
+#define X(name) {#name, name##_mm_init, name##_mm_malloc, name##_mm_free, name##_mm_realloc},
+static mm_impl_t impls[] = {MM_IMPLS};
+#undef X
+#else
+static mm_impl_t impls[] = {{"mm", mm_init, mm_malloc, mm_free, mm_realloc}};
+#endif
+#define NUM_IMPLS ((int)(sizeof(impls) / sizeof(impls[0])))
+static mm_impl_t *mm;
+
 /*********************
  * Function prototypes
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
 					 int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
+static range_t *range_insert(range_t *t, range_t *p);
+static range_t *range_delete(range_t *t, char *lo);
+
+/* Finding blocks by trace index when streaming */
+static void blockmap_init(blockmap_t *map);
+static void blockmap_free(blockmap_t *map);
+static blockent_t *blockmap_find(blockmap_t *map, uint32_t id);
+static void blockmap_put(blockmap_t *map, uint32_t id, char *block, size_t size);
+static void blockmap_del(blockmap_t *map, uint32_t id);
 
 /* These functions read, allocate, and free storage for traces */
-static trace_t *read_trace(char *tracedir, char *filename);
-static void free_trace(trace_t *trace);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -132,9 +280,36 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_latency(trace_t *trace, stats_t *stats);
+static void print_latency(latency_t *lat, unsigned long long ovhd);
+
+/* ... and of any package, reading the trace a chunk at a time (-s) */
+static int eval_mm_stream(char *tracedir, char *filename, int tracenum,
+						  range_t **ranges, stats_t *stats);
+static void eval_stream_speed(void *ptr);
+
+/* ... of the mm package on one trace, and on all of them in -j workers */
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats,
+						  int stream, int latency, int counters);
+static void eval_mm_jobs(char **tracefiles, int num_tracefiles, stats_t *stats,
+						 int stream, int latency, int counters, int jobs);
+static double time_section(fsecs_test_funct f, void *argp);
+static void timed_begin(void);
+static void timed_end(void);
+
+/* ... and of the mm package shared by several threads (-T) */
+static void eval_mm_threads(char **tracefiles, int num_tracefiles,
+							int firstnum, int nthreads, int xfree_pct);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printcounters(int n, stats_t *stats);
+static void write_json(char *path, char **tracefiles, int n, stats_t **stats,
+					   int *errs);
+static void write_csv(char *path, char **tracefiles, int n, stats_t **stats);
+static int compare_baseline(char *path, char **tracefiles, int n, stats_t **stats,
+							int stream);
+static double perf_index(int n, stats_t *stats, double *p1, double *p2);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -150,26 +325,53 @@ int main(int argc, char **argv)
 	char **tracefiles = NULL;	/* null-terminated array of trace file names */
 	int num_tracefiles = 0;		/* the number of traces in that array */
 	trace_t *trace = NULL;		/* stores a single trace file in memory */
-	range_t *ranges = NULL;		/* keeps track of block extents for one trace */
 	stats_t *libc_stats = NULL; /* libc stats for each trace */
-	stats_t *mm_stats = NULL;	/* mm (i.e. student) stats for each trace */
+	stats_t *mm_stats[NUM_IMPLS]; /* mm (i.e. student) stats for each package and trace */
+	int mm_errors[NUM_IMPLS];     /* errors found in each package */
+	int libc_errors;			  /* errors found before any package ran */
+	int m;
 	speed_t speed_params;		/* input parameters to the xx_speed routines */
+	stream_speed_t stream_params; /* ... and to eval_stream_speed */
 
 	int team_check = 1; /* If set, check team structure (reset by -a) */
 	int run_libc = 0;	/* If set, run libc malloc (set by -l) */
 	int autograder = 0; /* If set, emit summary info for autograder (-g) */
+	int stream = 0;		/* If set, read traces a chunk at a time (-s) */
+	int nthreads = 0;	/* If set, replay in this many threads (-T) */
+	int xfree_pct = 0;	/* ... freeing this % of blocks in another thread (-X) */
+	int jobs = 1;		/* evaluate this many traces at once (-j) */
+	int latency = 0;	/* If set, also time each call (-L) */
+	int counters = 0;	/* If set, count hardware events (-P) */
+	char *json = NULL;	/* write the results here as JSON (--json) */
+	char *csv = NULL;	/* ... and here as CSV (--csv) */
+	char *baseline = NULL; /* compare against this earlier --csv (--baseline) */
+	int regressions;
+	int backend = MEM_MALLOC; /* backing store for the heap (-b) */
+	int decommit = 0;	/* If set, decommit pages the heap gives back (-d) */
+	size_t max_heap = MAX_HEAP; /* heap size in bytes (-H) */
+	char *suffix;
 
 	/* temporaries used to compute the performance index */
-	double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
+	double p1, p2, perfindex;
 	int numcorrect;
 
 	/*
 	 * Read and interpret the command line arguments
 	 */
-	while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF)
+	while ((c = getopt_long(argc, argv, "f:t:b:H:T:X:j:hvVgadlsLP",
+							long_options, NULL)) != EOF)
 	{
 		switch (c)
 		{
+		case 'J': /* Results as JSON */
+			json = optarg;
+			break;
+		case 'C': /* Results as CSV */
+			csv = optarg;
+			break;
+		case 'B': /* Regression check against an earlier --csv */
+			baseline = optarg;
+			break;
 		case 'g': /* Generate summary info for the autograder */
 			autograder = 1;
 			break;
@@ -188,12 +390,84 @@ int main(int argc, char **argv)
 			if (tracedir[strlen(tracedir) - 1] != '/')
 				strcat(tracedir, "/"); /* path always ends with "/" */
 			break;
+		case 'b': /* Backing store for the simulated heap */
+			if (strcmp(optarg, "malloc") == 0)
+				backend = MEM_MALLOC;
+			else if (strcmp(optarg, "mmap") == 0)
+				backend = MEM_MMAP;
+			else if (strcmp(optarg, "thp") == 0)
+				backend = MEM_THP;
+			else
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'd': /* Decommit pages when the heap shrinks */
+			decommit = 1;
+			break;
+		case 'H': /* Heap size, with an optional K, M or G suffix */
+			max_heap = strtoull(optarg, &suffix, 10);
+			switch (*suffix)
+			{
+			case 'G':
+			case 'g':
+				max_heap <<= 10;
+				/* fall through */
+			case 'M':
+			case 'm':
+				max_heap <<= 10;
+				/* fall through */
+			case 'K':
+			case 'k':
+				max_heap <<= 10;
+				break;
+			}
+			if (max_heap == 0)
+			{
+				usage();
+				exit(1);
+			}
+			break;
 		case 'a': /* Don't check team structure */
 			team_check = 0;
 			break;
 		case 'l': /* Run libc malloc */
 			run_libc = 1;
 			break;
+		case 's': /* Stream the traces instead of loading them */
+			stream = 1;
+			break;
+		case 'L': /* Per-call latency histograms */
+			latency = 1;
+			break;
+		case 'P': /* Hardware performance counters */
+			counters = 1;
+			break;
+		case 'j': /* Evaluate traces in parallel worker processes */
+			jobs = atoi(optarg);
+			if (jobs <= 0)
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'T': /* Multithreaded replay */
+			nthreads = atoi(optarg);
+			if (nthreads <= 0)
+			{
+				usage();
+				exit(1);
+			}
+			break;
+		case 'X': /* Cross-thread frees in the multithreaded replay */
+			xfree_pct = atoi(optarg);
+			if (xfree_pct < 0 || xfree_pct > 100)
+			{
+				usage();
+				exit(1);
+			}
+			break;
 		case 'v': /* Print per-trace performance breakdown */
 			verbose = 1;
 			break;
@@ -209,9 +483,30 @@ int main(int argc, char **argv)
 		}
 	}
 
+	/* The latency replay needs the whole trace in memory */
+	if (latency && stream)
+	{
+		usage();
+		exit(1);
+	}
+
+	/* The multithreaded replay prints its own table and nothing else */
+	if (nthreads > 0)
+	{
+#if !MM_THREADS
+		app_error("ERROR: -T needs a thread-safe package (use mdriver-mt)");
+#endif
+		if (latency || counters || json || csv || baseline)
+			app_error("ERROR: -T cannot be combined with -L, -P, --json, --csv or --baseline");
+	}
+
 	/*
 	 * Check and print team info
 	 */
+#ifdef MM_IMPLS
+	(void)team_check; /* several packages, several teams */
+	run_libc = 1;	  /* libc is always one of the contenders */
+#else
 	if (team_check)
 	{
 		/* Students must fill in their team information */
@@ -239,6 +534,7 @@ int main(int argc, char **argv)
 		else if (*team.name2 != '\0')
 			printf("Member 2 :%s:%s\n", team.name2, team.id2);
 	}
+#endif
 
 	/*
 	 * If no -f command line arg, then use the entire set of tracefiles
@@ -253,6 +549,12 @@ int main(int argc, char **argv)
 
 	/* Initialize the timing package */
 	init_fsecs();
+	if (counters && perfctr_open() < 0)
+	{
+		printf("Hardware counters unavailable (%s); timing only.\n",
+			   perfctr_error());
+		counters = 0;
+	}
 
 	/*
 	 * Optionally run and evaluate the libc malloc package
@@ -270,6 +572,23 @@ int main(int argc, char **argv)
 		/* Evaluate the libc malloc package using the K-best scheme */
 		for (i = 0; i < num_tracefiles; i++)
 		{
+			if (stream)
+			{
+				/* libc is trusted to be valid; a failed call ends the run */
+				if (verbose > 1)
+					printf("Streaming tracefile: %s\n", tracefiles[i]);
+				mm = &libc_impl;
+				stream_params.tracedir = tracedir;
+				stream_params.filename = tracefiles[i];
+				stream_params.reset_heap = 0;
+				libc_stats[i].secs = fsecs(eval_stream_speed, &stream_params);
+				libc_stats[i].spread = fsecs_spread();
+				libc_stats[i].ops = stream_params.num_ops;
+				libc_stats[i].valid = 1;
+				continue;
+			}
+			if (verbose > 1)
+				printf("Reading tracefile: %s\n", tracefiles[i]);
 			trace = read_trace(tracedir, tracefiles[i]);
 			libc_stats[i].ops = trace->num_ops;
 			if (verbose > 1)
@@ -281,6 +600,7 @@ int main(int argc, char **argv)
 				if (verbose > 1)
 					printf("and performance.\n");
 				libc_stats[i].secs = fsecs(eval_libc_speed, &speed_params);
+				libc_stats[i].spread = fsecs_spread();
 			}
 			free_trace(trace);
 		}
@@ -293,101 +613,154 @@ int main(int argc, char **argv)
 		}
 	}
 
-	/*
-	 * Always run and evaluate the student's mm package
-	 */
-	if (verbose > 1)
-		printf("\nTesting mm malloc\n");
-
-	/* Allocate the mm stats array, with one stats_t struct per tracefile */
-	mm_stats = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
-	if (mm_stats == NULL)
-		unix_error("mm_stats calloc in main failed");
-
 	/* Initialize the simulated memory system in memlib.c */
+	mem_set_backend(backend);
+	mem_set_decommit(decommit);
+	mem_set_max_heap(max_heap);
 	mem_init();
+	if (verbose)
+		printf("Heap backing store: %s\n", mem_backend_name());
 
-	/* Evaluate student's mm malloc package using the K-best scheme */
-	for (i = 0; i < num_tracefiles; i++)
+	/*
+	 * The multithreaded replay replaces the usual evaluation
+	 */
+	if (nthreads > 0)
 	{
-		trace = read_trace(tracedir, tracefiles[i]);
-		mm_stats[i].ops = trace->num_ops;
-		if (verbose > 1)
-			printf("Checking mm_malloc for correctness, ");
-		mm_stats[i].valid = eval_mm_valid(trace, i, &ranges);
-		if (mm_stats[i].valid)
+		for (m = 0; m < NUM_IMPLS; m++)
 		{
-			if (verbose > 1)
-				printf("efficiency, ");
-			mm_stats[i].util = eval_mm_util(trace, i, &ranges);
-			speed_params.trace = trace;
-			speed_params.ranges = ranges;
-			if (verbose > 1)
-				printf("and performance.\n");
-			mm_stats[i].secs = fsecs(eval_mm_speed, &speed_params);
+			mm = &impls[m];
+			for (i = 0; i < num_tracefiles; i += nthreads)
+				eval_mm_threads(tracefiles + i, num_tracefiles - i, i,
+								nthreads, xfree_pct);
 		}
-		free_trace(trace);
-	}
-
-	/* Display the mm results in a compact table */
-	if (verbose)
-	{
-		printf("\nResults for mm malloc:\n");
-		printresults(num_tracefiles, mm_stats);
-		printf("\n");
+		exit(errors > 0);
 	}
 
 	/*
-	 * Accumulate the aggregate statistics for the student's mm package
+	 * Always run and evaluate the student's mm package(s).  Every
+	 * package gets a fresh heap for every trace: the eval_mm_*
+	 * routines call mem_reset_brk before mm->init.
 	 */
-	secs = 0;
-	ops = 0;
-	util = 0;
-	numcorrect = 0;
-	for (i = 0; i < num_tracefiles; i++)
+	libc_errors = errors;
+	for (m = 0; m < NUM_IMPLS; m++)
 	{
-		secs += mm_stats[i].secs;
-		ops += mm_stats[i].ops;
-		util += mm_stats[i].util;
-		if (mm_stats[i].valid)
-			numcorrect++;
+		mm = &impls[m];
+		errors = libc_errors;
+		if (verbose > 1)
+			printf("\nTesting %s malloc\n", mm->name);
+
+		/* Allocate the mm stats array, with one stats_t struct per tracefile */
+		mm_stats[m] = (stats_t *)calloc(num_tracefiles, sizeof(stats_t));
+		if (mm_stats[m] == NULL)
+			unix_error("mm_stats calloc in main failed");
+
+		/* Evaluate student's mm malloc package using the K-best scheme */
+		if (jobs > 1)
+			eval_mm_jobs(tracefiles, num_tracefiles, mm_stats[m], stream,
+						 latency, counters, jobs);
+		else
+			for (i = 0; i < num_tracefiles; i++)
+				eval_mm_trace(tracefiles[i], i, &mm_stats[m][i], stream,
+							  latency, counters);
+
+		/* Display the mm results in a compact table */
+		if (verbose)
+		{
+			printf("\nResults for %s malloc:\n", mm->name);
+			printresults(num_tracefiles, mm_stats[m]);
+			printf("\n");
+		}
+		if (counters)
+		{
+			printf("Hardware events per op for %s malloc:\n", mm->name);
+			printcounters(num_tracefiles, mm_stats[m]);
+			printf("\n");
+		}
+		mm_errors[m] = errors;
 	}
-	avg_mm_util = util / num_tracefiles;
 
 	/*
-	 * Compute and print the performance index
+	 * Compute and print the performance index of each package
 	 */
-	if (errors == 0)
+	for (m = 0; m < NUM_IMPLS; m++)
 	{
-		avg_mm_throughput = ops / secs;
-
-		p1 = UTIL_WEIGHT * avg_mm_util;
-		if (avg_mm_throughput > AVG_LIBC_THRUPUT)
+		errors = mm_errors[m];
+		if (NUM_IMPLS > 1)
+			printf("%s: ", impls[m].name);
+		if (errors == 0)
 		{
-			p2 = (double)(1.0 - UTIL_WEIGHT);
+			perfindex = perf_index(num_tracefiles, mm_stats[m], &p1, &p2);
+			printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
+				   p1 * 100,
+				   p2 * 100,
+				   perfindex);
 		}
 		else
-		{
-			p2 = ((double)(1.0 - UTIL_WEIGHT)) *
-				 (avg_mm_throughput / AVG_LIBC_THRUPUT);
+		{ /* There were errors */
+			perfindex = 0.0;
+			printf("Terminated with %d errors\n", errors);
 		}
 
-		perfindex = (p1 + p2) * 100.0;
-		printf("Perf index = %.0f (util) + %.0f (thru) = %.0f/100\n",
-			   p1 * 100,
-			   p2 * 100,
-			   perfindex);
+		if (autograder && m == 0)
+		{
+			numcorrect = 0;
+			for (i = 0; i < num_tracefiles; i++)
+				if (mm_stats[m][i].valid)
+					numcorrect++;
+			printf("correct:%d\n", numcorrect);
+			printf("perfidx:%.0f\n", perfindex);
+		}
 	}
-	else
-	{ /* There were errors */
-		perfindex = 0.0;
-		printf("Terminated with %d errors\n", errors);
+
+	/*
+	 * Several packages: put them side by side
+	 */
+	if (NUM_IMPLS > 1)
+	{
+		printf("\nComparison over %d traces:\n", num_tracefiles);
+		printf("%-12s%7s%6s%9s%6s\n", "malloc", "valid", "util", "Kops", "perf");
+		for (m = -1; m < NUM_IMPLS; m++)
+		{
+			stats_t *stats = (m < 0) ? libc_stats : mm_stats[m];
+			double secs = 0, ops = 0;
+
+			numcorrect = 0;
+			for (i = 0; i < num_tracefiles; i++)
+			{
+				if (!stats[i].valid)
+					continue;
+				numcorrect++;
+				secs += stats[i].secs;
+				ops += stats[i].ops;
+			}
+			printf("%-12s%4d/%-2d", (m < 0) ? "libc" : impls[m].name,
+				   numcorrect, num_tracefiles);
+
+			/* Utilization and the index mean nothing for libc */
+			if (m < 0 || mm_errors[m] > 0)
+			{
+				printf("%6s%9.0f%6s\n", "-",
+					   (secs > 0) ? (ops / 1e3) / secs : 0.0, "-");
+				continue;
+			}
+			perfindex = perf_index(num_tracefiles, stats, &p1, &p2);
+			printf("%5.0f%%%9.0f%6.0f\n", p1 / UTIL_WEIGHT * 100.0,
+				   (secs > 0) ? (ops / 1e3) / secs : 0.0, perfindex);
+		}
 	}
 
-	if (autograder)
+	/*
+	 * Machine-readable results, and the regression check
+	 */
+	if (json != NULL)
+		write_json(json, tracefiles, num_tracefiles, mm_stats, mm_errors);
+	if (csv != NULL)
+		write_csv(csv, tracefiles, num_tracefiles, mm_stats);
+	if (baseline != NULL)
 	{
-		printf("correct:%d\n", numcorrect);
-		printf("perfidx:%.0f\n", perfindex);
+		regressions = compare_baseline(baseline, tracefiles, num_tracefiles, mm_stats,
+									   stream);
+		exit(regressions > 0);
 	}
 
 	exit(0);
@@ -405,11 +778,11 @@ int main(int argc, char **argv)
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list.
  */
-static int add_range(range_t **ranges, char *lo, int size,
+static int add_range(range_t **ranges, char *lo, size_t size,
 					 int tracenum, int opnum)
 {
 	char *hi = lo + size - 1;
-	range_t *p;
+	range_t *p, *t;
 	char msg[MAXLINE];
 
 	assert(size > 0);
@@ -423,9 +796,10 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must lie within the extent of the heap */
-	if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
-		(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi()))
+	/* The payload must lie within the extent of the heap, or of a mapping */
+	if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) ||
+		 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+		!(mem_is_mapped(lo) && mem_is_mapped(hi)))
 	{
 		sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 				lo, hi, mem_heap_lo(), mem_heap_hi());
@@ -433,29 +807,39 @@ static int add_range(range_t **ranges, char *lo, int size,
 		return 0;
 	}
 
-	/* The payload must not overlap any other payloads */
-	for (p = *ranges; p != NULL; p = p->next)
+	/*
+	 * The payload must not overlap any other payloads.  The ranges in
+	 * the tree never overlap each other, so the only candidate is the
+	 * one with the highest lo that is still <= hi.
+	 */
+	p = NULL;
+	for (t = *ranges; t != NULL;)
 	{
-		if ((lo >= p->lo && lo <= p->hi) ||
-			(hi >= p->lo && hi <= p->hi))
+		if (t->lo <= hi)
 		{
-			sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
-					lo, hi, p->lo, p->hi);
-			malloc_error(tracenum, opnum, msg);
-			return 0;
+			p = t;
+			t = t->right;
 		}
+		else
+			t = t->left;
+	}
+	if (p != NULL && p->hi >= lo)
+	{
+		sprintf(msg, "Payload (%p:%p) overlaps another payload (%p:%p)\n",
+				lo, hi, p->lo, p->hi);
+		malloc_error(tracenum, opnum, msg);
+		return 0;
 	}
 
 	/*
 	 * Everything looks OK, so remember the extent of this block
-	 * by creating a range struct and adding it the range list.
+	 * by creating a range struct and adding it the range tree.
 	 */
 	if ((p = (range_t *)malloc(sizeof(range_t))) == NULL)
 		unix_error("malloc error in add_range");
-	p->next = *ranges;
 	p->lo = lo;
 	p->hi = hi;
-	*ranges = p;
+	*ranges = range_insert(*ranges, p);
 	return 1;
 }
 
@@ -464,21 +848,7 @@ static int add_range(range_t **ranges, char *lo, int size,
  */
 static void remove_range(range_t **ranges, char *lo)
 {
-	range_t *p;
-	range_t **prevpp = ranges;
-	int size;
-
-	for (p = *ranges; p != NULL; p = p->next)
-	{
-		if (p->lo == lo)
-		{
-			*prevpp = p->next;
-			size = p->hi - p->lo + 1;
-			free(p);
-			break;
-		}
-		prevpp = &(p->next);
-	}
+	*ranges = range_delete(*ranges, lo);
 }
 
 /*
@@ -486,119 +856,218 @@ static void remove_range(range_t **ranges, char *lo)
  */
 static void clear_ranges(range_t **ranges)
 {
-	range_t *p;
-	range_t *pnext;
+	range_t *p = *ranges;
 
-	for (p = *ranges; p != NULL; p = pnext)
-	{
-		pnext = p->next;
-		free(p);
-	}
+	if (p == NULL)
+		return;
+	clear_ranges(&p->left);
+	clear_ranges(&p->right);
+	free(p);
 	*ranges = NULL;
 }
 
-/**********************************************
- * The following routines manipulate tracefiles
- *********************************************/
-
 /*
- * read_trace - read a trace file and store it in memory
+ * The AA tree behind the range records.  Every left child is one level
+ * below its parent, and a right child is at most on its parent's level,
+ * but never two right links in a row.  skew and split restore the two
+ * rules on the way back up from an insert or delete.
  */
-static trace_t *read_trace(char *tracedir, char *filename)
+#define RANGE_LEVEL(t) ((t) == NULL ? 0 : (t)->level)
+
+/* skew - Rotate right when t has a left child on its own level */
+static range_t *range_skew(range_t *t)
 {
-	FILE *tracefile;
-	trace_t *trace;
-	char type[MAXLINE];
-	char path[MAXLINE];
-	unsigned index, size;
-	unsigned max_index = 0;
-	unsigned op_index;
+	range_t *l;
+
+	if (t == NULL || RANGE_LEVEL(t->left) != t->level)
+		return t;
+	l = t->left;
+	t->left = l->right;
+	l->right = t;
+	return l;
+}
 
-	if (verbose > 1)
-		printf("Reading tracefile: %s\n", filename);
+/* split - Rotate left and promote when t has two right links on its level */
+static range_t *range_split(range_t *t)
+{
+	range_t *r;
+
+	if (t == NULL || t->right == NULL ||
+		RANGE_LEVEL(t->right->right) != t->level)
+		return t;
+	r = t->right;
+	t->right = r->left;
+	r->left = t;
+	r->level++;
+	return r;
+}
 
-	/* Allocate the trace record */
-	if ((trace = (trace_t *)malloc(sizeof(trace_t))) == NULL)
-		unix_error("malloc 1 failed in read_trance");
+/*
+ * range_insert - Add range p to the tree rooted at t, return the new root
+ */
+static range_t *range_insert(range_t *t, range_t *p)
+{
+	if (t == NULL)
+	{
+		p->left = p->right = NULL;
+		p->level = 1;
+		return p;
+	}
+	if (p->lo < t->lo)
+		t->left = range_insert(t->left, p);
+	else
+		t->right = range_insert(t->right, p);
+	return range_split(range_skew(t));
+}
 
-	/* Read the trace file header */
-	strcpy(path, tracedir);
-	strcat(path, filename);
-	if ((tracefile = fopen(path, "r")) == NULL)
+/*
+ * range_delete - Free the range starting at lo, if there is one, from the
+ *     tree rooted at t, return the new root
+ */
+static range_t *range_delete(range_t *t, char *lo)
+{
+	range_t *p;
+	int level;
+
+	if (t == NULL)
+		return NULL;
+	if (lo < t->lo)
+		t->left = range_delete(t->left, lo);
+	else if (lo > t->lo)
+		t->right = range_delete(t->right, lo);
+	else if (t->left == NULL && t->right == NULL)
 	{
-		sprintf(msg, "Could not open %s in read_trace", path);
-		unix_error(msg);
+		free(t);
+		return NULL;
 	}
-	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
-	fscanf(tracefile, "%d", &(trace->num_ids));
-	fscanf(tracefile, "%d", &(trace->num_ops));
-	fscanf(tracefile, "%d", &(trace->weight)); /* not used */
-
-	/* We'll store each request line in the trace in this array */
-	if ((trace->ops =
-			 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
-		unix_error("malloc 2 failed in read_trace");
-
-	/* We'll keep an array of pointers to the allocated blocks here... */
-	if ((trace->blocks =
-			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
-		unix_error("malloc 3 failed in read_trace");
-
-	/* ... along with the corresponding byte sizes of each block */
-	if ((trace->block_sizes =
-			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
-		unix_error("malloc 4 failed in read_trace");
-
-	/* read every request line in the trace file */
-	index = 0;
-	op_index = 0;
-	while (fscanf(tracefile, "%s", type) != EOF)
+	else
 	{
-		switch (type[0])
-		{
-		case 'a':
-			fscanf(tracefile, "%u %u", &index, &size);
-			trace->ops[op_index].type = ALLOC;
-			trace->ops[op_index].index = index;
-			trace->ops[op_index].size = size;
-			max_index = (index > max_index) ? index : max_index;
-			break;
-		case 'r':
-			fscanf(tracefile, "%u %u", &index, &size);
-			trace->ops[op_index].type = REALLOC;
-			trace->ops[op_index].index = index;
-			trace->ops[op_index].size = size;
-			max_index = (index > max_index) ? index : max_index;
-			break;
-		case 'f':
-			fscanf(tracefile, "%ud", &index);
-			trace->ops[op_index].type = FREE;
-			trace->ops[op_index].index = index;
-			break;
-		default:
-			printf("Bogus type character (%c) in tracefile %s\n",
-				   type[0], path);
-			exit(1);
-		}
-		op_index++;
+		/* Take over the extent of a neighbour and delete that instead */
+		if (t->left == NULL)
+			for (p = t->right; p->left != NULL; p = p->left)
+				;
+		else
+			for (p = t->left; p->right != NULL; p = p->right)
+				;
+		t->lo = p->lo;
+		t->hi = p->hi;
+		if (t->left == NULL)
+			t->right = range_delete(t->right, p->lo);
+		else
+			t->left = range_delete(t->left, p->lo);
 	}
-	fclose(tracefile);
-	assert(max_index == trace->num_ids - 1);
-	assert(trace->num_ops == op_index);
 
-	return trace;
+	/* Pull t and its right spine down if a child is now too low */
+	level = RANGE_LEVEL(t->left) < RANGE_LEVEL(t->right) ? RANGE_LEVEL(t->left) : RANGE_LEVEL(t->right);
+	level++;
+	if (level < t->level)
+	{
+		t->level = level;
+		if (level < RANGE_LEVEL(t->right))
+			t->right->level = level;
+	}
+	t = range_skew(t);
+	t->right = range_skew(t->right);
+	if (t->right != NULL)
+		t->right->right = range_skew(t->right->right);
+	t = range_split(t);
+	t->right = range_split(t->right);
+	return t;
 }
 
 /*
- * free_trace - Free the trace record and the three arrays it points
- *              to, all of which were allocated in read_trace().
+ * The block map used when streaming.  Deletion shifts later entries of
+ * a probe sequence back, so there are no tombstones and the table never
+ * holds more than twice the live blocks (or BLOCKMAP_MIN_BITS slots).
  */
-void free_trace(trace_t *trace)
+#define BLOCKMAP_HASH(map, id) \
+	((size_t)(((uint64_t)(id) * 0x9E3779B97F4A7C15ULL) >> (64 - (map)->bits)))
+
+/* blockmap_resize - Rehash map into 1 << bits slots */
+static void blockmap_resize(blockmap_t *map, int bits)
+{
+	blockent_t *old = map->tab;
+	size_t i, oldsize = (size_t)1 << map->bits;
+
+	if ((map->tab = (blockent_t *)calloc((size_t)1 << bits, sizeof(blockent_t))) == NULL)
+		unix_error("calloc error in blockmap_resize");
+	map->bits = bits;
+	map->live = 0;
+	for (i = 0; i < oldsize; i++)
+		if (old[i].block != NULL)
+			blockmap_put(map, old[i].id, old[i].block, old[i].size);
+	free(old);
+}
+
+static void blockmap_init(blockmap_t *map)
+{
+	map->bits = BLOCKMAP_MIN_BITS;
+	map->live = 0;
+	if ((map->tab = (blockent_t *)calloc((size_t)1 << map->bits, sizeof(blockent_t))) == NULL)
+		unix_error("calloc error in blockmap_init");
+}
+
+static void blockmap_free(blockmap_t *map)
 {
-	free(trace->ops); /* free the three arrays... */
-	free(trace->blocks);
-	free(trace->block_sizes);
-	free(trace); /* and the trace record itself... */
+	free(map->tab);
+	map->tab = NULL;
+}
+
+/* blockmap_find - The entry of block id, or NULL if it is not live */
+static blockent_t *blockmap_find(blockmap_t *map, uint32_t id)
+{
+	size_t mask = ((size_t)1 << map->bits) - 1;
+	size_t i;
+
+	for (i = BLOCKMAP_HASH(map, id); map->tab[i].block != NULL; i = (i + 1) & mask)
+		if (map->tab[i].id == id)
+			return &map->tab[i];
+	return NULL;
+}
+
+/* blockmap_put - Set the payload of block id, adding it if need be */
+static void blockmap_put(blockmap_t *map, uint32_t id, char *block, size_t size)
+{
+	size_t mask = ((size_t)1 << map->bits) - 1;
+	size_t i;
+
+	for (i = BLOCKMAP_HASH(map, id); map->tab[i].block != NULL; i = (i + 1) & mask)
+		if (map->tab[i].id == id)
+			break;
+	if (map->tab[i].block == NULL)
+		map->live++;
+	map->tab[i].id = id;
+	map->tab[i].block = block;
+	map->tab[i].size = size;
+	if (2 * map->live > mask + 1)
+		blockmap_resize(map, map->bits + 1);
+}
+
+/* blockmap_del - Forget block id */
+static void blockmap_del(blockmap_t *map, uint32_t id)
+{
+	size_t mask = ((size_t)1 << map->bits) - 1;
+	blockent_t *e = blockmap_find(map, id);
+	size_t i, j, k;
+
+	if (e == NULL)
+		return;
+
+	/* Close the gap with any later entry that may not probe past it */
+	i = e - map->tab;
+	for (j = (i + 1) & mask; map->tab[j].block != NULL; j = (j + 1) & mask)
+	{
+		k = BLOCKMAP_HASH(map, map->tab[j].id);
+		if (((j - k) & mask) >= ((j - i) & mask))
+		{
+			map->tab[i] = map->tab[j];
+			i = j;
+		}
+	}
+	map->tab[i].block = NULL;
+	map->live--;
+	if (map->bits > BLOCKMAP_MIN_BITS && 8 * map->live < mask + 1)
+		blockmap_resize(map, map->bits - 1);
 }
 
 /**********************************************************************
@@ -611,10 +1080,11 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 {
-	int i, j;
+	int i;
+	size_t j;
 	int index;
-	int size;
-	int oldsize;
+	size_t size;
+	size_t oldsize;
 	char *newp;
 	char *oldp;
 	char *p;
@@ -624,7 +1094,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 	clear_ranges(ranges);
 
 	/* Call the mm package's init function */
-	if (mm_init() < 0)
+	if (mm->init() < 0)
 	{
 		malloc_error(tracenum, 0, "mm_init failed.");
 		return 0;
@@ -642,7 +1112,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 		case ALLOC: /* mm_malloc */
 
 			/* Call the student's malloc */
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = mm->malloc(size)) == NULL)
 			{
 				malloc_error(tracenum, i, "mm_malloc failed.");
 				return 0;
@@ -672,7 +1142,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
 			/* Call the student's realloc */
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, size)) == NULL)
+			if ((newp = mm->realloc(oldp, size)) == NULL)
 			{
 				malloc_error(tracenum, i, "mm_realloc failed.");
 				return 0;
@@ -695,7 +1165,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 				oldsize = size;
 			for (j = 0; j < oldsize; j++)
 			{
-				if (newp[j] != (index & 0xFF))
+				if (newp[j] != (char)(index & 0xFF))
 				{
 					malloc_error(tracenum, i, "mm_realloc did not preserve the "
 											  "data from old block");
@@ -714,7 +1184,7 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 			/* Remove region from list and call student's free function */
 			p = trace->blocks[index];
 			remove_range(ranges, p);
-			mm_free(p);
+			mm->free(p);
 			break;
 
 		default:
@@ -731,25 +1201,25 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the
- *   size of the heap in bytes after running the student's malloc
- *   package on the trace. Note that our implementation of mem_sbrk()
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap.
+ *   largest size the heap reached while running the student's malloc
+ *   package on the trace. mem_sbrk() lets the package shrink the heap
+ *   again, so the final size can be smaller; that is reported
+ *   separately and does not affect utilization.
  *
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {
 	int i;
 	int index;
-	int size, newsize, oldsize;
-	int max_total_size = 0;
-	int total_size = 0;
+	size_t size, newsize, oldsize;
+	size_t max_total_size = 0;
+	size_t total_size = 0;
 	char *p;
 	char *newp, *oldp;
 
 	/* initialize the heap and the mm malloc package */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	if (mm->init() < 0)
 		app_error("mm_init failed in eval_mm_util");
 
 	for (i = 0; i < trace->num_ops; i++)
@@ -761,7 +1231,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			index = trace->ops[i].index;
 			size = trace->ops[i].size;
 
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = mm->malloc(size)) == NULL)
 				app_error("mm_malloc failed in eval_mm_util");
 
 			/* Remember region and size */
@@ -782,7 +1252,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			oldsize = trace->block_sizes[index];
 
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, newsize)) == NULL)
+			if ((newp = mm->realloc(oldp, newsize)) == NULL)
 				app_error("mm_realloc failed in eval_mm_util");
 
 			/* Remember region and size */
@@ -802,7 +1272,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 			size = trace->block_sizes[index];
 			p = trace->blocks[index];
 
-			mm_free(p);
+			mm->free(p);
 
 			/* Keep track of current total size
 			 * of all allocated blocks */
@@ -815,7 +1285,7 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 		}
 	}
 
-	return ((double)max_total_size / (double)mem_heapsize());
+	return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 /*
@@ -824,13 +1294,14 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
  */
 static void eval_mm_speed(void *ptr)
 {
-	int i, index, size, newsize;
+	int i, index;
+	size_t size, newsize;
 	char *p, *newp, *oldp, *block;
 	trace_t *trace = ((speed_t *)ptr)->trace;
 
 	/* Reset the heap and initialize the mm package */
 	mem_reset_brk();
-	if (mm_init() < 0)
+	if (mm->init() < 0)
 		app_error("mm_init failed in eval_mm_speed");
 
 	/* Interpret each trace request */
@@ -841,7 +1312,7 @@ static void eval_mm_speed(void *ptr)
 		case ALLOC: /* mm_malloc */
 			index = trace->ops[i].index;
 			size = trace->ops[i].size;
-			if ((p = mm_malloc(size)) == NULL)
+			if ((p = mm->malloc(size)) == NULL)
 				app_error("mm_malloc error in eval_mm_speed");
 			trace->blocks[index] = p;
 			break;
@@ -850,7 +1321,7 @@ static void eval_mm_speed(void *ptr)
 			index = trace->ops[i].index;
 			newsize = trace->ops[i].size;
 			oldp = trace->blocks[index];
-			if ((newp = mm_realloc(oldp, newsize)) == NULL)
+			if ((newp = mm->realloc(oldp, newsize)) == NULL)
 				app_error("mm_realloc error in eval_mm_speed");
 			trace->blocks[index] = newp;
 			break;
@@ -858,7 +1329,7 @@ static void eval_mm_speed(void *ptr)
 		case FREE: /* mm_free */
 			index = trace->ops[i].index;
 			block = trace->blocks[index];
-			mm_free(block);
+			mm->free(block);
 			break;
 
 		default:
@@ -867,74 +1338,818 @@ static void eval_mm_speed(void *ptr)
 }
 
 /*
- * eval_libc_valid - We run this function to make sure that the
- *    libc malloc can run to completion on the set of traces.
- *    We'll be conservative and terminate if any libc malloc call fails.
- *
+ * eval_mm_latency - Replay a trace timing each call to the mm package
+ *     on its own with serialized counter reads, and print percentiles
+ *     of the latencies.  The least cost of an empty pair of reads is
+ *     taken off every sample, so what remains is the call itself.
+ *     Those of each type of call are also kept in stats->latency.
  */
-static int eval_libc_valid(trace_t *trace, int tracenum)
+static void eval_mm_latency(trace_t *trace, stats_t *stats)
 {
-	int i, newsize;
-	char *p, *newp, *oldp;
+	int i, index, type;
+	size_t size;
+	char *p;
+	unsigned long long t0, t1, ovhd;
+	latency_t *lat;
+	hist_t all;
+
+	if ((lat = malloc(sizeof(latency_t))) == NULL)
+		unix_error("malloc failed in eval_mm_latency");
+	for (type = 0; type < 3; type++)
+		for (i = 0; i < LAT_CLASSES; i++)
+			hist_reset(&lat->hist[type][i]);
+	ovhd = cycles_ovhd();
+
+	/* Reset the heap and initialize the mm package */
+	mem_reset_brk();
+	if (mm->init() < 0)
+		app_error("mm_init failed in eval_mm_latency");
 
 	for (i = 0; i < trace->num_ops; i++)
 	{
-		switch (trace->ops[i].type)
+		type = trace->ops[i].type;
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (type)
 		{
-
-		case ALLOC: /* malloc */
-			if ((p = malloc(trace->ops[i].size)) == NULL)
-			{
-				malloc_error(tracenum, i, "libc malloc failed");
-				unix_error("System message");
-			}
-			trace->blocks[trace->ops[i].index] = p;
+		case ALLOC: /* mm_malloc */
+			t0 = cycles_begin();
+			p = mm->malloc(size);
+			t1 = cycles_end();
+			if (p == NULL)
+				app_error("mm_malloc error in eval_mm_latency");
+			trace->blocks[index] = p;
+			trace->block_sizes[index] = size;
 			break;
 
-		case REALLOC: /* realloc */
-			newsize = trace->ops[i].size;
-			oldp = trace->blocks[trace->ops[i].index];
-			if ((newp = realloc(oldp, newsize)) == NULL)
-			{
-				malloc_error(tracenum, i, "libc realloc failed");
-				unix_error("System message");
-			}
-			trace->blocks[trace->ops[i].index] = newp;
+		case REALLOC: /* mm_realloc */
+			t0 = cycles_begin();
+			p = mm->realloc(trace->blocks[index], size);
+			t1 = cycles_end();
+			if (p == NULL)
+				app_error("mm_realloc error in eval_mm_latency");
+			trace->blocks[index] = p;
+			trace->block_sizes[index] = size;
 			break;
 
-		case FREE: /* free */
-			free(trace->blocks[trace->ops[i].index]);
+		case FREE: /* mm_free */
+			size = trace->block_sizes[index];
+			t0 = cycles_begin();
+			mm->free(trace->blocks[index]);
+			t1 = cycles_end();
 			break;
 
 		default:
-			app_error("invalid operation type  in eval_libc_valid");
+			app_error("Nonexistent request type in eval_mm_latency");
+			return;
 		}
+		hist_record(&lat->hist[type][LAT_CLASS(size)],
+					(t1 - t0 > ovhd) ? t1 - t0 - ovhd : 0);
 	}
 
-	return 1;
+	for (type = 0; type < 3; type++)
+	{
+		hist_reset(&all);
+		for (i = 0; i < LAT_CLASSES; i++)
+			hist_add(&all, &lat->hist[type][i]);
+		for (i = 0; i < LAT_PCTS; i++)
+			if (all.count == 0)
+				stats->latency[type][i] = -1;
+			else
+				stats->latency[type][i] = 1e9 / cycles_hz() *
+					((lat_pcts[i] < 100) ? hist_percentile(&all, lat_pcts[i]) : all.max);
+	}
+	stats->timed_calls = 1;
+
+	print_latency(lat, ovhd);
+	free(lat);
 }
 
 /*
- * eval_libc_speed - This is the function that is used by fcyc() to
- *    measure the running time of the libc malloc package on the set
- *    of traces.
+ * print_latency - Print p50/p99/p99.9/max of each type of call, in
+ *     nanoseconds, and below it those of each size class it was made in
  */
-static void eval_libc_speed(void *ptr)
+static void print_latency(latency_t *lat, unsigned long long ovhd)
 {
-	int i;
-	int index, size, newsize;
-	char *p, *newp, *oldp, *block;
-	trace_t *trace = ((speed_t *)ptr)->trace;
-
-	for (i = 0; i < trace->num_ops; i++)
+	static char *names[] = {"malloc", "free", "realloc"};
+	static char *classes[] = {"<=64", "<=1K", "<=16K", ">16K"};
+	double ns = 1e9 / cycles_hz();
+	hist_t all;
+	hist_t *h;
+	int type, c;
+
+	printf("%-9s%6s%9s%9s%9s%9s%10s\n",
+		   "call", "size", "count", "p50", "p99", "p99.9", "max(ns)");
+	for (type = 0; type < 3; type++)
 	{
-		switch (trace->ops[i].type)
+		hist_reset(&all);
+		for (c = 0; c < LAT_CLASSES; c++)
+			hist_add(&all, &lat->hist[type][c]);
+		if (all.count == 0)
+			continue;
+		for (c = -1; c < LAT_CLASSES; c++)
 		{
-		case ALLOC: /* malloc */
-			index = trace->ops[i].index;
-			size = trace->ops[i].size;
-			if ((p = malloc(size)) == NULL)
-				unix_error("malloc failed in eval_libc_speed");
+			h = (c < 0) ? &all : &lat->hist[type][c];
+			if (h->count == 0 || (c >= 0 && h->count == all.count))
+				continue;
+			printf("%-9s%6s%9llu%9.0f%9.0f%9.0f%10.0f\n",
+				   (c < 0) ? names[type] : "",
+				   (c < 0) ? "all" : classes[c],
+				   (unsigned long long)h->count,
+				   hist_percentile(h, 50) * ns,
+				   hist_percentile(h, 99) * ns,
+				   hist_percentile(h, 99.9) * ns,
+				   h->max * ns);
+		}
+	}
+	printf("(timer overhead of %.0f ns taken off each call)\n", ovhd * ns);
+}
+
+/*
+ * eval_mm_stream - Check the mm malloc package for correctness and
+ *     measure its utilization in one replay of a trace that is read a
+ *     chunk at a time.  The checks are those of eval_mm_valid, and the
+ *     utilization that of eval_mm_util.  Fills in stats->ops and
+ *     stats->util and returns whether the package is valid.
+ */
+static int eval_mm_stream(char *tracedir, char *filename, int tracenum,
+						  range_t **ranges, stats_t *stats)
+{
+	tstream_t *s;
+	traceop_t *ops;
+	blockmap_t map;
+	blockent_t *e;
+	int i, k, n;
+	int valid = 0;
+	size_t j;
+	uint32_t index;
+	size_t size, oldsize;
+	size_t max_total_size = 0;
+	size_t total_size = 0;
+	char *p, *newp, *oldp;
+
+	/* Reset the heap and free any records in the range tree */
+	s = open_trace_stream(tracedir, filename);
+	stats->ops = s->num_ops;
+	blockmap_init(&map);
+	mem_reset_brk();
+	clear_ranges(ranges);
+
+	/* Call the mm package's init function */
+	if (mm->init() < 0)
+	{
+		malloc_error(tracenum, 0, "mm_init failed.");
+		goto out;
+	}
+
+	/* Interpret each operation in the trace in order */
+	i = 0;
+	while ((n = trace_stream_next(s, &ops)) > 0)
+		for (k = 0; k < n; k++, i++)
+		{
+			index = ops[k].index;
+			size = ops[k].size;
+
+			switch (ops[k].type)
+			{
+
+			case ALLOC: /* mm_malloc */
+				if ((p = mm->malloc(size)) == NULL)
+				{
+					malloc_error(tracenum, i, "mm_malloc failed.");
+					goto out;
+				}
+				if (add_range(ranges, p, size, tracenum, i) == 0)
+					goto out;
+				memset(p, index & 0xFF, size);
+				blockmap_put(&map, index, p, size);
+				total_size += size;
+				break;
+
+			case REALLOC: /* mm_realloc */
+				e = blockmap_find(&map, index);
+				oldp = (e != NULL) ? e->block : NULL;
+				oldsize = (e != NULL) ? e->size : 0;
+				if ((newp = mm->realloc(oldp, size)) == NULL)
+				{
+					malloc_error(tracenum, i, "mm_realloc failed.");
+					goto out;
+				}
+				if (oldp != NULL)
+					remove_range(ranges, oldp);
+				if (add_range(ranges, newp, size, tracenum, i) == 0)
+					goto out;
+
+				/* The old data must have come along */
+				for (j = 0; j < ((size < oldsize) ? size : oldsize); j++)
+				{
+					if (newp[j] != (char)(index & 0xFF))
+					{
+						malloc_error(tracenum, i, "mm_realloc did not preserve the "
+												  "data from old block");
+						goto out;
+					}
+				}
+				memset(newp, index & 0xFF, size);
+				blockmap_put(&map, index, newp, size);
+				total_size += size - oldsize;
+				break;
+
+			case FREE: /* mm_free */
+				if ((e = blockmap_find(&map, index)) == NULL)
+					app_error("Free of a block that is not allocated in eval_mm_stream");
+				remove_range(ranges, e->block);
+				mm->free(e->block);
+				total_size -= e->size;
+				blockmap_del(&map, index);
+				break;
+
+			default:
+				app_error("Nonexistent request type in eval_mm_stream");
+			}
+			max_total_size = (total_size > max_total_size) ? total_size : max_total_size;
+		}
+
+	/* As far as we know, this is a valid malloc package */
+	stats->util = (double)max_total_size / (double)mem_peak_heapsize();
+	valid = 1;
+out:
+	blockmap_free(&map);
+	close_trace_stream(s);
+	return valid;
+}
+
+/*
+ * eval_stream_speed - This is the function that is used by fcyc()
+ *    to measure the running time of a malloc package (mm, or libc
+ *    through libc_impl) on a trace that is read a chunk at a time.
+ *    The time includes finding blocks in the block map and any wait
+ *    for the trace to be read.
+ */
+static void eval_stream_speed(void *ptr)
+{
+	stream_speed_t *params = (stream_speed_t *)ptr;
+	tstream_t *s;
+	traceop_t *ops;
+	blockmap_t map;
+	blockent_t *e;
+	int k, n;
+	char *p;
+
+	s = open_trace_stream(params->tracedir, params->filename);
+	params->num_ops = s->num_ops;
+	blockmap_init(&map);
+
+	/* Reset the heap and initialize the mm package */
+	if (params->reset_heap)
+		mem_reset_brk();
+	if (mm->init() < 0)
+		app_error("mm_init failed in eval_stream_speed");
+
+	/* Interpret each trace request */
+	while ((n = trace_stream_next(s, &ops)) > 0)
+		for (k = 0; k < n; k++)
+			switch (ops[k].type)
+			{
+
+			case ALLOC: /* mm_malloc */
+				if ((p = mm->malloc(ops[k].size)) == NULL)
+					app_error("mm_malloc error in eval_stream_speed");
+				blockmap_put(&map, ops[k].index, p, ops[k].size);
+				break;
+
+			case REALLOC: /* mm_realloc */
+				e = blockmap_find(&map, ops[k].index);
+				if ((p = mm->realloc(e ? e->block : NULL, ops[k].size)) == NULL)
+					app_error("mm_realloc error in eval_stream_speed");
+				blockmap_put(&map, ops[k].index, p, ops[k].size);
+				break;
+
+			case FREE: /* mm_free */
+				if ((e = blockmap_find(&map, ops[k].index)) == NULL)
+					app_error("Free of a block that is not allocated in eval_stream_speed");
+				mm->free(e->block);
+				blockmap_del(&map, ops[k].index);
+				break;
+
+			default:
+				app_error("Nonexistent request type in eval_stream_speed");
+			}
+
+	blockmap_free(&map);
+	close_trace_stream(s);
+}
+
+/*
+ * time_section - fsecs, but with -j a worker holds the timing lock for
+ *     writing, so no other worker runs while it is timed and parallel
+ *     workers do not skew each other's throughput.  timed_begin and
+ *     timed_end take and drop it around other timed work.
+ */
+static double time_section(fsecs_test_funct f, void *argp)
+{
+	double secs;
+
+	timed_begin();
+	secs = fsecs(f, argp);
+	timed_end();
+	return secs;
+}
+
+static void timed_begin(void)
+{
+	if (timing_lock != NULL)
+		pthread_rwlock_wrlock(timing_lock);
+}
+
+static void timed_end(void)
+{
+	if (timing_lock != NULL)
+		pthread_rwlock_unlock(timing_lock);
+}
+
+/*
+ * untimed_begin/untimed_end - Bracket the untimed work of a -j worker.
+ *     Any number of workers may check and measure at once, but they
+ *     hold off while another is timed.
+ */
+static void untimed_begin(void)
+{
+	if (timing_lock != NULL)
+		pthread_rwlock_rdlock(timing_lock);
+}
+
+static void untimed_end(void)
+{
+	if (timing_lock != NULL)
+		pthread_rwlock_unlock(timing_lock);
+}
+
+/*
+ * eval_mm_trace - Evaluate the mm package on one trace: check it for
+ *     correctness, measure its utilization, and time it
+ */
+static void eval_mm_trace(char *filename, int tracenum, stats_t *stats,
+						  int stream, int latency, int counters)
+{
+	trace_t *trace;
+	range_t *ranges = NULL;
+	speed_t speed_params;
+	stream_speed_t stream_params;
+
+	if (stream)
+	{
+		/* Correctness and efficiency share one replay */
+		if (verbose > 1)
+			printf("Streaming tracefile: %s\n", filename);
+		if (verbose > 1)
+			printf("Checking mm_malloc for correctness and efficiency, ");
+		untimed_begin();
+		stats->valid = eval_mm_stream(tracedir, filename, tracenum, &ranges, stats);
+		untimed_end();
+		if (stats->valid)
+		{
+			stats->peak_heap = mem_peak_heapsize();
+			stats->final_heap = mem_heapsize() + mem_mapsize();
+			stream_params.tracedir = tracedir;
+			stream_params.filename = filename;
+			stream_params.reset_heap = 1;
+			if (verbose > 1)
+				printf("and performance.\n");
+			stats->secs = time_section(eval_stream_speed, &stream_params);
+			stats->spread = fsecs_spread();
+			if (counters)
+			{
+				timed_begin();
+				stats->counted = (perfctr_run(eval_stream_speed, &stream_params,
+											  stats->counts) == 0);
+				timed_end();
+			}
+		}
+		clear_ranges(&ranges);
+		return;
+	}
+
+	if (verbose > 1)
+		printf("Reading tracefile: %s\n", filename);
+	trace = read_trace(tracedir, filename);
+	stats->ops = trace->num_ops;
+	if (verbose > 1)
+		printf("Checking mm_malloc for correctness, ");
+	untimed_begin();
+	stats->valid = eval_mm_valid(trace, tracenum, &ranges);
+	if (stats->valid)
+	{
+		if (verbose > 1)
+			printf("efficiency, ");
+		stats->util = eval_mm_util(trace, tracenum, &ranges);
+	}
+	untimed_end();
+	if (stats->valid)
+	{
+		stats->peak_heap = mem_peak_heapsize();
+		stats->final_heap = mem_heapsize() + mem_mapsize();
+		speed_params.trace = trace;
+		speed_params.ranges = ranges;
+		if (verbose > 1)
+			printf("and performance.\n");
+		stats->secs = time_section(eval_mm_speed, &speed_params);
+		stats->spread = fsecs_spread();
+		if (counters)
+		{
+			timed_begin();
+			stats->counted = (perfctr_run(eval_mm_speed, &speed_params,
+										  stats->counts) == 0);
+			timed_end();
+		}
+	}
+	if (stats->valid && latency)
+	{
+		/* Whole, so that a -j worker's table is not split up */
+		timed_begin();
+		printf("\nLatency of %s malloc on trace %d (%s):\n",
+			   mm->name, tracenum, filename);
+		eval_mm_latency(trace, stats);
+		fflush(stdout);
+		timed_end();
+	}
+	clear_ranges(&ranges);
+	free_trace(trace);
+}
+
+/*
+ * eval_mm_jobs - Evaluate the mm package on every trace in up to jobs
+ *     forked workers.  Worker k takes traces k, k + jobs, ..., and runs
+ *     on its own CPU where there are enough.  Each replays on its
+ *     copy-on-write copy of the parent's heap, so blocks land where they
+ *     would in a serial run.  The results come back through shared memory.
+ */
+static void eval_mm_jobs(char **tracefiles, int num_tracefiles, stats_t *stats,
+						 int stream, int latency, int counters, int jobs)
+{
+	job_result_t *results;
+	pthread_rwlockattr_t attr;
+	size_t len;
+	cpu_set_t allowed, mine;
+	int cpus[CPU_SETSIZE];
+	int ncpus = 0;
+	int i, k, status;
+	pid_t pid;
+
+	/* The results, then the timing lock, in memory the workers share */
+	len = num_tracefiles * sizeof(job_result_t) + sizeof(pthread_rwlock_t);
+	results = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (results == MAP_FAILED)
+		unix_error("mmap failed in eval_mm_jobs");
+	timing_lock = (pthread_rwlock_t *)(results + num_tracefiles);
+
+	/* A waiting writer must stop new readers, or timing could starve */
+	pthread_rwlockattr_init(&attr);
+	pthread_rwlockattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+	pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+	if (pthread_rwlock_init(timing_lock, &attr) != 0)
+		app_error("pthread_rwlock_init failed in eval_mm_jobs");
+	pthread_rwlockattr_destroy(&attr);
+
+	/* The CPUs we may run on, for pinning the workers */
+	if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+		for (i = 0; i < CPU_SETSIZE; i++)
+			if (CPU_ISSET(i, &allowed))
+				cpus[ncpus++] = i;
+
+	if (jobs > num_tracefiles)
+		jobs = num_tracefiles;
+	fflush(stdout);
+	for (k = 0; k < jobs; k++)
+	{
+		if ((pid = fork()) < 0)
+			unix_error("fork failed in eval_mm_jobs");
+		if (pid > 0)
+			continue;
+
+		/* The worker */
+		if (ncpus > 0)
+		{
+			CPU_ZERO(&mine);
+			CPU_SET(cpus[k % ncpus], &mine);
+			sched_setaffinity(0, sizeof(mine), &mine);
+		}
+		for (i = k; i < num_tracefiles; i += jobs)
+		{
+			errors = 0;
+			eval_mm_trace(tracefiles[i], i, &results[i].stats, stream,
+						  latency, counters);
+			results[i].errors = errors;
+		}
+		fflush(stdout);
+		_exit(0);
+	}
+
+	/* A worker that died leaves its remaining traces invalid */
+	while ((pid = wait(&status)) > 0)
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+		{
+			printf("ERROR: worker %d terminated abnormally\n", (int)pid);
+			errors++;
+		}
+
+	for (i = 0; i < num_tracefiles; i++)
+	{
+		stats[i] = results[i].stats;
+		errors += results[i].errors;
+	}
+	pthread_rwlock_destroy(timing_lock);
+	timing_lock = NULL;
+	munmap(results, len);
+}
+
+/*
+ * The multithreaded replay.  MT_XFREE picks, by a hash of the trace
+ * index, the blocks whose free is handed to the next thread.
+ */
+#define MT_XFREE(index, pct) \
+	((int)((((uint32_t)(index) * 2654435761u) >> 16) % 100) < (pct))
+
+static double mt_secs(struct timespec *start, struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* mt_drain - Free the blocks other threads have handed to self */
+static void mt_drain(mt_thread_t *self)
+{
+	unsigned head = self->xfree_head;
+	unsigned tail = __atomic_load_n(&self->xfree_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail)
+		mm->free(self->xfree[head++ % MT_RING]);
+	__atomic_store_n(&self->xfree_head, head, __ATOMIC_RELEASE);
+}
+
+/* mt_push - Hand block p to thread to, to be freed there */
+static void mt_push(mt_thread_t *self, mt_thread_t *to, char *p)
+{
+	unsigned tail = to->xfree_tail;
+
+	/* Keep draining our own ring while we wait, or a full cycle deadlocks */
+	while (tail - __atomic_load_n(&to->xfree_head, __ATOMIC_ACQUIRE) == MT_RING)
+	{
+		mt_drain(self);
+		sched_yield();
+	}
+	to->xfree[tail % MT_RING] = p;
+	__atomic_store_n(&to->xfree_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * mt_replay - The body of each replay thread: wait for the others, then
+ *     replay the thread's trace against the shared package
+ */
+static void *mt_replay(void *arg)
+{
+	mt_thread_t *self = (mt_thread_t *)arg;
+	mt_run_t *run = self->run;
+	mt_thread_t *next = &run->threads[(self->id + 1) % run->nthreads];
+	trace_t *trace = self->trace;
+	int i, index;
+	char *p;
+
+	pthread_barrier_wait(&run->barrier);
+	clock_gettime(CLOCK_MONOTONIC, &self->start);
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		if (self->xfree_head != __atomic_load_n(&self->xfree_tail, __ATOMIC_ACQUIRE))
+			mt_drain(self);
+
+		index = trace->ops[i].index;
+		switch (trace->ops[i].type)
+		{
+
+		case ALLOC: /* mm_malloc */
+			if ((p = mm->malloc(trace->ops[i].size)) == NULL)
+				app_error("mm_malloc error in mt_replay");
+			self->blocks[index] = p;
+			break;
+
+		case REALLOC: /* mm_realloc */
+			if ((p = mm->realloc(self->blocks[index], trace->ops[i].size)) == NULL)
+				app_error("mm_realloc error in mt_replay");
+			self->blocks[index] = p;
+			break;
+
+		case FREE: /* mm_free, here or in the next thread */
+			if (MT_XFREE(index, run->xfree_pct))
+				mt_push(self, next, self->blocks[index]);
+			else
+				mm->free(self->blocks[index]);
+			break;
+
+		default:
+			app_error("Nonexistent request type in mt_replay");
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &self->end);
+
+	/* Frees may still be coming from the thread before us */
+	__atomic_sub_fetch(&run->active, 1, __ATOMIC_RELEASE);
+	while (__atomic_load_n(&run->active, __ATOMIC_ACQUIRE) > 0)
+	{
+		mt_drain(self);
+		sched_yield();
+	}
+	mt_drain(self);
+	return NULL;
+}
+
+/*
+ * eval_mm_threads - Replay up to nthreads traces in nthreads threads at
+ *     once against the mm package, which must be thread-safe.  Thread i
+ *     replays trace i % num_tracefiles; the caller passes the rest of
+ *     the traces to later calls, firstnum being the number of the first
+ *     one.  Each trace is first checked single-threaded with
+ *     eval_mm_valid.  Prints the per-thread and aggregate throughput of
+ *     the best of MT_RUNS runs.
+ */
+static void eval_mm_threads(char **tracefiles, int num_tracefiles,
+							int firstnum, int nthreads, int xfree_pct)
+{
+	mt_run_t run;
+	mt_thread_t *t;
+	trace_t **traces;
+	range_t *ranges = NULL;
+	struct timespec start, end;
+	double secs, best = DBL_MAX;
+	double *best_secs;
+	double ops = 0;
+	int ntraces = (nthreads < num_tracefiles) ? nthreads : num_tracefiles;
+	int errors_before = errors;
+	int i, r;
+
+	if ((traces = (trace_t **)calloc(ntraces, sizeof(trace_t *))) == NULL ||
+		(best_secs = (double *)calloc(nthreads, sizeof(double))) == NULL ||
+		(run.threads = (mt_thread_t *)calloc(nthreads, sizeof(mt_thread_t))) == NULL)
+		unix_error("calloc failed in eval_mm_threads");
+
+	for (i = 0; i < ntraces; i++)
+	{
+		if (verbose > 1)
+			printf("Reading tracefile: %s\n", tracefiles[i]);
+		traces[i] = read_trace(tracedir, tracefiles[i]);
+		eval_mm_valid(traces[i], firstnum + i, &ranges);
+	}
+	clear_ranges(&ranges);
+	if (errors > errors_before)
+	{
+		printf("Terminated with %d errors\n", errors - errors_before);
+		return;
+	}
+
+	run.nthreads = nthreads;
+	run.xfree_pct = xfree_pct;
+	for (i = 0; i < nthreads; i++)
+	{
+		t = &run.threads[i];
+		t->id = i;
+		t->run = &run;
+		t->trace = traces[i % ntraces];
+		if ((t->blocks = (char **)malloc(t->trace->num_ids * sizeof(char *))) == NULL)
+			unix_error("malloc failed in eval_mm_threads");
+		ops += t->trace->num_ops;
+	}
+
+	for (r = 0; r < MT_RUNS; r++)
+	{
+		mem_reset_brk();
+		if (mm->init() < 0)
+			app_error("mm_init failed in eval_mm_threads");
+		run.active = nthreads;
+		pthread_barrier_init(&run.barrier, NULL, nthreads);
+		for (i = 0; i < nthreads; i++)
+		{
+			t = &run.threads[i];
+			t->xfree_head = t->xfree_tail = 0;
+			if ((errno = pthread_create(&t->tid, NULL, mt_replay, t)) != 0)
+				unix_error("pthread_create failed in eval_mm_threads");
+		}
+		for (i = 0; i < nthreads; i++)
+			pthread_join(run.threads[i].tid, NULL);
+		pthread_barrier_destroy(&run.barrier);
+
+		/* The run lasts from the first start to the last finish */
+		start = run.threads[0].start;
+		end = run.threads[0].end;
+		for (i = 1; i < nthreads; i++)
+		{
+			t = &run.threads[i];
+			if (mt_secs(&t->start, &start) > 0)
+				start = t->start;
+			if (mt_secs(&end, &t->end) > 0)
+				end = t->end;
+		}
+		secs = mt_secs(&start, &end);
+		if (verbose > 1)
+			printf("Run %d: %.6f secs\n", r, secs);
+		if (secs < best)
+		{
+			best = secs;
+			for (i = 0; i < nthreads; i++)
+				best_secs[i] = mt_secs(&run.threads[i].start, &run.threads[i].end);
+		}
+	}
+
+	printf("\n%s malloc, %d threads, %d%% cross-thread frees, best of %d runs:\n",
+		   mm->name, nthreads, xfree_pct, MT_RUNS);
+	printf("%6s  %-20s%8s%10s%8s\n", "thread", "trace", "ops", "secs", "Kops");
+	for (i = 0; i < nthreads; i++)
+	{
+		t = &run.threads[i];
+		printf("%6d  %-20s%8d%10.6f%8.0f\n", i, tracefiles[i % ntraces],
+			   t->trace->num_ops, best_secs[i],
+			   (t->trace->num_ops / 1e3) / best_secs[i]);
+	}
+	printf("%-28s%8.0f%10.6f%8.0f\n", "Total", ops, best, (ops / 1e3) / best);
+
+	for (i = 0; i < nthreads; i++)
+		free(run.threads[i].blocks);
+	for (i = 0; i < ntraces; i++)
+		free_trace(traces[i]);
+	free(run.threads);
+	free(traces);
+	free(best_secs);
+}
+
+/*
+ * eval_libc_valid - We run this function to make sure that the
+ *    libc malloc can run to completion on the set of traces.
+ *    We'll be conservative and terminate if any libc malloc call fails.
+ *
+ */
+static int eval_libc_valid(trace_t *trace, int tracenum)
+{
+	int i;
+	size_t newsize;
+	char *p, *newp, *oldp;
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		switch (trace->ops[i].type)
+		{
+
+		case ALLOC: /* malloc */
+			if ((p = malloc(trace->ops[i].size)) == NULL)
+			{
+				malloc_error(tracenum, i, "libc malloc failed");
+				unix_error("System message");
+			}
+			trace->blocks[trace->ops[i].index] = p;
+			break;
+
+		case REALLOC: /* realloc */
+			newsize = trace->ops[i].size;
+			oldp = trace->blocks[trace->ops[i].index];
+			if ((newp = realloc(oldp, newsize)) == NULL)
+			{
+				malloc_error(tracenum, i, "libc realloc failed");
+				unix_error("System message");
+			}
+			trace->blocks[trace->ops[i].index] = newp;
+			break;
+
+		case FREE: /* free */
+			free(trace->blocks[trace->ops[i].index]);
+			break;
+
+		default:
+			app_error("invalid operation type  in eval_libc_valid");
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * eval_libc_speed - This is the function that is used by fcyc() to
+ *    measure the running time of the libc malloc package on the set
+ *    of traces.
+ */
+static void eval_libc_speed(void *ptr)
+{
+	int i;
+	int index;
+	size_t size, newsize;
+	char *p, *newp, *oldp, *block;
+	trace_t *trace = ((speed_t *)ptr)->trace;
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		switch (trace->ops[i].type)
+		{
+		case ALLOC: /* malloc */
+			index = trace->ops[i].index;
+			size = trace->ops[i].size;
+			if ((p = malloc(size)) == NULL)
+				unix_error("malloc failed in eval_libc_speed");
 			trace->blocks[index] = p;
 			break;
 
@@ -972,31 +2187,39 @@ static void printresults(int n, stats_t *stats)
 	double util = 0;
 
 	/* Print the individual results for each trace */
-	printf("%5s%7s %5s%8s%10s%6s\n",
-		   "trace", " valid", "util", "ops", "secs", "Kops");
+	printf("%5s%7s %5s%8s%10s%7s%6s%9s%9s\n",
+		   "trace", " valid", "util", "ops", "secs", "+/-", "Kops", "peakKB", "finalKB");
 	for (i = 0; i < n; i++)
 	{
 		if (stats[i].valid)
 		{
-			printf("%2d%10s%5.0f%%%8.0f%10.6f%6.0f\n",
+			printf("%2d%10s%5.0f%%%8.0f%10.6f%6.1f%%%6.0f",
 				   i,
 				   "yes",
 				   stats[i].util * 100.0,
 				   stats[i].ops,
 				   stats[i].secs,
+				   stats[i].spread * 100.0,
 				   (stats[i].ops / 1e3) / stats[i].secs);
+			if (stats[i].peak_heap > 0) /* not tracked for libc */
+				printf("%9.0f%9.0f\n",
+					   stats[i].peak_heap / 1024.0,
+					   stats[i].final_heap / 1024.0);
+			else
+				printf("%9s%9s\n", "-", "-");
 			secs += stats[i].secs;
 			ops += stats[i].ops;
 			util += stats[i].util;
 		}
 		else
 		{
-			printf("%2d%10s%6s%8s%10s%6s\n",
+			printf("%2d%10s%6s%8s%10s%7s%6s\n",
 				   i,
 				   "no",
 				   "-",
 				   "-",
 				   "-",
+				   "-",
 				   "-");
 		}
 	}
@@ -1004,24 +2227,500 @@ static void printresults(int n, stats_t *stats)
 	/* Print the aggregate results for the set of traces */
 	if (errors == 0)
 	{
-		printf("%12s%5.0f%%%8.0f%10.6f%6.0f\n",
+		printf("%12s%5.0f%%%8.0f%10.6f%7s%6.0f\n",
 			   "Total       ",
 			   (util / n) * 100.0,
 			   ops,
 			   secs,
+			   "",
 			   (ops / 1e3) / secs);
 	}
 	else
 	{
-		printf("%12s%6s%8s%10s%6s\n",
+		printf("%12s%6s%8s%10s%7s%6s\n",
 			   "Total       ",
 			   "-",
 			   "-",
 			   "-",
+			   "",
 			   "-");
 	}
 }
 
+/*
+ * printcounters - prints the hardware events of each trace's counted
+ *     run, per op, for some malloc package
+ */
+static void printcounters(int n, stats_t *stats)
+{
+	int i, e;
+	double ops = 0;
+	double total[PERFCTR_EVENTS] = {0};
+
+	printf("%5s", "trace");
+	for (e = 0; e < PERFCTR_EVENTS; e++)
+		printf("%10s", perfctr_names[e]);
+	printf("\n");
+	for (i = 0; i < n; i++)
+	{
+		printf("%2d   ", i);
+		for (e = 0; e < PERFCTR_EVENTS; e++)
+		{
+			if (!stats[i].valid || !stats[i].counted || stats[i].counts[e] < 0)
+			{
+				printf("%10s", "-");
+				total[e] = -1;
+				continue;
+			}
+			printf("%10.2f", stats[i].counts[e] / stats[i].ops);
+			if (total[e] >= 0)
+				total[e] += stats[i].counts[e];
+		}
+		printf("\n");
+		if (stats[i].valid)
+			ops += stats[i].ops;
+	}
+
+	/* An event missed in any trace has no total */
+	printf("%-5s", "Total");
+	for (e = 0; e < PERFCTR_EVENTS; e++)
+		if (total[e] >= 0 && ops > 0)
+			printf("%10.2f", total[e] / ops);
+		else
+			printf("%10s", "-");
+	printf("\n");
+}
+
+/*
+ * json_string - Write s as a JSON string
+ */
+static void json_string(FILE *f, char *s)
+{
+	fputc('"', f);
+	for (; *s; s++)
+		if (*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if ((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	fputc('"', f);
+}
+
+/*
+ * write_json - Write the results of every package, with what built and
+ *     ran them, to path as JSON.  Numbers that were not measured are
+ *     null.
+ */
+static void write_json(char *path, char **tracefiles, int n, stats_t **stats,
+					   int *errs)
+{
+	FILE *f;
+	struct utsname host;
+	char when[64];
+	time_t now = time(NULL);
+	double p1, p2, perfindex;
+	stats_t *st;
+	int m, i, t, k;
+
+	if ((f = fopen(path, "w")) == NULL)
+		unix_error("Could not open JSON output in write_json");
+	uname(&host);
+	strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%S%z", localtime(&now));
+
+	fprintf(f, "{\n  \"build\": {\"compiler\": ");
+	json_string(f, __VERSION__);
+#ifdef __OPTIMIZE__
+	fprintf(f, ", \"optimized\": true");
+#else
+	fprintf(f, ", \"optimized\": false");
+#endif
+	fprintf(f, ", \"built\": \"%s %s\", \"alignment\": %d},\n",
+			__DATE__, __TIME__, ALIGNMENT);
+	fprintf(f, "  \"run\": {\"host\": ");
+	json_string(f, host.nodename);
+	fprintf(f, ", \"system\": ");
+	json_string(f, host.release);
+	fprintf(f, ", \"time\": \"%s\", \"clock\": \"%s\", \"backend\": \"%s\"},\n",
+			when, cycles_source(), mem_backend_name());
+
+	fprintf(f, "  \"packages\": [");
+	for (m = 0; m < NUM_IMPLS; m++)
+	{
+		fprintf(f, "%s\n    {\"name\": ", (m > 0) ? "," : "");
+		json_string(f, impls[m].name);
+		fprintf(f, ", \"errors\": %d", errs[m]);
+		if (errs[m] == 0)
+		{
+			perfindex = perf_index(n, stats[m], &p1, &p2);
+			fprintf(f, ", \"perf_index\": %.2f, \"util_index\": %.2f, \"thru_index\": %.2f",
+					perfindex, p1 * 100, p2 * 100);
+		}
+		else
+			fprintf(f, ", \"perf_index\": null");
+		fprintf(f, ",\n     \"traces\": [");
+		for (i = 0; i < n; i++)
+		{
+			st = &stats[m][i];
+			fprintf(f, "%s\n      {\"trace\": ", (i > 0) ? "," : "");
+			json_string(f, tracefiles[i]);
+			fprintf(f, ", \"valid\": %s", st->valid ? "true" : "false");
+			if (st->valid)
+				fprintf(f, ", \"util\": %.6f, \"ops\": %.0f, \"secs\": %.9f, "
+						   "\"spread\": %.6f, \"kops\": %.3f, \"peak_kb\": %.0f, "
+						   "\"final_kb\": %.0f",
+						st->util, st->ops, st->secs, st->spread,
+						(st->ops / 1e3) / st->secs,
+						st->peak_heap / 1024.0, st->final_heap / 1024.0);
+			if (st->valid && st->timed_calls)
+			{
+				fprintf(f, ",\n       \"latency_ns\": {");
+				for (t = 0; t < 3; t++)
+				{
+					fprintf(f, "%s\"%s\": ", (t > 0) ? ", " : "", call_names[t]);
+					if (st->latency[t][0] < 0)
+					{
+						fprintf(f, "null");
+						continue;
+					}
+					fprintf(f, "{\"p50\": %.0f, \"p99\": %.0f, \"p99.9\": %.0f, \"max\": %.0f}",
+							st->latency[t][0], st->latency[t][1],
+							st->latency[t][2], st->latency[t][3]);
+				}
+				fprintf(f, "}");
+			}
+			if (st->valid && st->counted)
+			{
+				fprintf(f, ",\n       \"per_op\": {");
+				for (k = 0; k < PERFCTR_EVENTS; k++)
+				{
+					fprintf(f, "%s\"%s\": ", (k > 0) ? ", " : "", perfctr_names[k]);
+					if (st->counts[k] < 0)
+						fprintf(f, "null");
+					else
+						fprintf(f, "%.4f", st->counts[k] / st->ops);
+				}
+				fprintf(f, "}");
+			}
+			fprintf(f, "}");
+		}
+		fprintf(f, "\n     ]}");
+	}
+	fprintf(f, "\n  ]\n}\n");
+	fclose(f);
+}
+
+/*
+ * csv_string - Write s as a CSV cell, quoted if it has to be
+ */
+static void csv_string(FILE *f, char *s)
+{
+	if (strpbrk(s, ",\"\r\n") == NULL)
+	{
+		fputs(s, f);
+		return;
+	}
+	fputc('"', f);
+	for (; *s; s++)
+	{
+		if (*s == '"')
+			fputc('"', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+/*
+ * write_csv - Write the results of every package to path as CSV, one
+ *     row per package and trace.  Cells that were not measured are
+ *     empty.  This is also the format --baseline reads.
+ */
+static void write_csv(char *path, char **tracefiles, int n, stats_t **stats)
+{
+	FILE *f;
+	stats_t *st;
+	int m, i, t, k;
+
+	if ((f = fopen(path, "w")) == NULL)
+		unix_error("Could not open CSV output in write_csv");
+
+	fprintf(f, "package,trace,valid,util,ops,secs,spread,kops,peak_kb,final_kb");
+	for (t = 0; t < 3; t++)
+		fprintf(f, ",%s_p50_ns,%s_p99_ns,%s_p999_ns,%s_max_ns",
+				call_names[t], call_names[t], call_names[t], call_names[t]);
+	for (k = 0; k < PERFCTR_EVENTS; k++)
+		fprintf(f, ",%s_per_op", perfctr_names[k]);
+	fprintf(f, "\n");
+
+	for (m = 0; m < NUM_IMPLS; m++)
+		for (i = 0; i < n; i++)
+		{
+			st = &stats[m][i];
+			csv_string(f, impls[m].name);
+			fputc(',', f);
+			csv_string(f, tracefiles[i]);
+			fprintf(f, ",%d", st->valid);
+			if (st->valid)
+				fprintf(f, ",%.6f,%.0f,%.9f,%.6f,%.3f,%.0f,%.0f",
+						st->util, st->ops, st->secs, st->spread,
+						(st->ops / 1e3) / st->secs,
+						st->peak_heap / 1024.0, st->final_heap / 1024.0);
+			else
+				fprintf(f, ",,,,,,,");
+			for (t = 0; t < 3; t++)
+				for (k = 0; k < LAT_PCTS; k++)
+					if (st->valid && st->timed_calls && st->latency[t][k] >= 0)
+						fprintf(f, ",%.0f", st->latency[t][k]);
+					else
+						fprintf(f, ",");
+			for (k = 0; k < PERFCTR_EVENTS; k++)
+				if (st->valid && st->counted && st->counts[k] >= 0)
+					fprintf(f, ",%.4f", st->counts[k] / st->ops);
+				else
+					fprintf(f, ",");
+			fprintf(f, "\n");
+		}
+	fclose(f);
+}
+
+/*
+ * csv_split - Split a CSV line in place into at most max cells,
+ *     unquoting the quoted ones.  Returns the number of cells.
+ */
+static int csv_split(char *line, char **cells, int max)
+{
+	int n = 0;
+	char *in = line, *out, *next;
+
+	line[strcspn(line, "\r\n")] = '\0';
+	while (n < max && in != NULL)
+	{
+		cells[n++] = out = in;
+		if (*in == '"')
+		{
+			for (in++; *in != '\0'; *out++ = *in++)
+				if (*in == '"' && *++in != '"')
+					break;
+			in += strcspn(in, ",");
+		}
+		else
+			while (*in != '\0' && *in != ',')
+				*out++ = *in++;
+		next = (*in == ',') ? in + 1 : NULL;
+		*out = '\0';
+		in = next;
+	}
+	return n;
+}
+
+/*
+ * trace_name - The file name of a trace, without its directory
+ */
+static char *trace_name(char *path)
+{
+	char *slash = strrchr(path, '/');
+
+	return (slash != NULL) ? slash + 1 : path;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+	double x = *(const double *)a, y = *(const double *)b;
+
+	return (x > y) - (x < y);
+}
+
+/*
+ * retime_kops - Run trace tracenum through package m BASE_RETIMES more
+ *     times and return the median throughput of those runs and the
+ *     first, which gave kops.
+ */
+static double retime_kops(int m, char *tracefile, int tracenum, double kops,
+						  int stream)
+{
+	double runs[BASE_RETIMES + 1];
+	mm_impl_t *saved = mm;
+	stats_t st;
+	int r;
+
+	runs[0] = kops;
+	mm = &impls[m];
+	for (r = 1; r <= BASE_RETIMES; r++)
+	{
+		memset(&st, 0, sizeof(st));
+		eval_mm_trace(tracefile, tracenum, &st, stream, 0, 0);
+		runs[r] = st.valid ? (st.ops / 1e3) / st.secs : 0;
+	}
+	mm = saved;
+	qsort(runs, BASE_RETIMES + 1, sizeof(double), cmp_double);
+	return runs[BASE_RETIMES / 2];
+}
+
+/*
+ * compare_baseline - Compare the results with those of an earlier run,
+ *     written by --csv to path, trace by trace, and print the changes
+ *     that matter.  Traces are matched by package and file name, so the
+ *     directories they were read from need not agree.  A trace regresses
+ *     if it is no longer valid, if its utilization fell by more than
+ *     BASE_UTIL_DROP, or if its throughput fell by more than
+ *     BASE_THRU_DROP and by more than the spreads of the two runs put
+ *     together, so that the two medians lie outside each other's
+ *     interquartile ranges.  A slowdown must also hold for the median of
+ *     the run and BASE_RETIMES more, since one run can be slowed by the
+ *     rest of the machine.  Returns the number of regressions, or 1 if
+ *     no trace could be compared.
+ */
+static int compare_baseline(char *path, char **tracefiles, int n, stats_t **stats,
+							int stream)
+{
+	FILE *f;
+	char line[4 * MAXLINE];
+	char *cells[64];
+	int col_pkg = -1, col_trace = -1, col_valid = -1, col_util = -1;
+	int col_kops = -1, col_spread = -1;
+	int ncells, c, m, i;
+	int compared = 0, regressions = 0;
+	double base_util, base_kops, base_spread, kops, change;
+	double log_ratios = 0;
+	int timed = 0;
+	char *seen;
+	stats_t *st;
+
+	if ((f = fopen(path, "r")) == NULL)
+		unix_error("Could not open the baseline in compare_baseline");
+	if ((seen = (char *)calloc(NUM_IMPLS * n, 1)) == NULL)
+		unix_error("calloc failed in compare_baseline");
+
+	/* Find the columns we need by name */
+	if (fgets(line, sizeof(line), f) == NULL)
+		app_error("The baseline is empty");
+	ncells = csv_split(line, cells, 64);
+	for (c = 0; c < ncells; c++)
+		if (!strcmp(cells[c], "package"))
+			col_pkg = c;
+		else if (!strcmp(cells[c], "trace"))
+			col_trace = c;
+		else if (!strcmp(cells[c], "valid"))
+			col_valid = c;
+		else if (!strcmp(cells[c], "util"))
+			col_util = c;
+		else if (!strcmp(cells[c], "kops"))
+			col_kops = c;
+		else if (!strcmp(cells[c], "spread"))
+			col_spread = c;
+	if (col_pkg < 0 || col_trace < 0 || col_valid < 0 || col_util < 0 ||
+		col_kops < 0 || col_spread < 0)
+		app_error("The baseline was not written by --csv");
+
+	printf("\nAgainst baseline %s:\n", path);
+	while (fgets(line, sizeof(line), f) != NULL)
+	{
+		if (csv_split(line, cells, 64) != ncells)
+			continue;
+		for (m = 0; m < NUM_IMPLS; m++)
+			if (!strcmp(cells[col_pkg], impls[m].name))
+				break;
+		for (i = 0; i < n; i++)
+			if (!strcmp(trace_name(cells[col_trace]), trace_name(tracefiles[i])))
+				break;
+		if (m == NUM_IMPLS || i == n)
+			continue;
+		seen[m * n + i] = 1;
+		if (atoi(cells[col_valid]) == 0)
+			continue;
+		st = &stats[m][i];
+		compared++;
+
+		if (!st->valid)
+		{
+			printf("%s %s: REGRESSION, no longer valid\n", impls[m].name, tracefiles[i]);
+			regressions++;
+			continue;
+		}
+
+		base_util = atof(cells[col_util]);
+		if (base_util - st->util > BASE_UTIL_DROP)
+		{
+			printf("%s %s: REGRESSION, util %.1f%% -> %.1f%%\n", impls[m].name,
+				   tracefiles[i], base_util * 100.0, st->util * 100.0);
+			regressions++;
+		}
+		else if (st->util - base_util > BASE_UTIL_DROP)
+			printf("%s %s: util %.1f%% -> %.1f%%\n", impls[m].name,
+				   tracefiles[i], base_util * 100.0, st->util * 100.0);
+
+		base_kops = atof(cells[col_kops]);
+		base_spread = atof(cells[col_spread]);
+		if (base_kops <= 0)
+			continue;
+		kops = (st->ops / 1e3) / st->secs;
+		change = (kops - base_kops) / base_kops;
+		if (change < -BASE_THRU_DROP && -change > base_spread + st->spread)
+		{
+			kops = retime_kops(m, tracefiles[i], i, kops, stream);
+			change = (kops - base_kops) / base_kops;
+		}
+		log_ratios += log(kops / base_kops);
+		timed++;
+		if (fabs(change) <= BASE_THRU_DROP || fabs(change) <= base_spread + st->spread)
+			continue;
+		printf("%s %s: %sKops %.0f -> %.0f (%+.1f%%, spread %.1f%% and %.1f%%)\n",
+			   impls[m].name, tracefiles[i], (change < 0) ? "REGRESSION, " : "",
+			   base_kops, kops, change * 100.0,
+			   base_spread * 100.0, st->spread * 100.0);
+		if (change < 0)
+			regressions++;
+	}
+	fclose(f);
+
+	for (m = 0; m < NUM_IMPLS; m++)
+		for (i = 0; i < n; i++)
+			if (!seen[m * n + i])
+				printf("%s %s: not in the baseline\n", impls[m].name, tracefiles[i]);
+	free(seen);
+
+	if (timed > 0)
+		printf("Throughput %+.1f%% over all traces (geometric mean)\n",
+			   (exp(log_ratios / timed) - 1) * 100.0);
+	printf("%d regressions in %d traces compared\n", regressions, compared);
+	if (compared == 0)
+	{
+		printf("ERROR: no trace in this run has a valid row in the baseline\n");
+		return 1;
+	}
+	return regressions;
+}
+
+/*
+ * perf_index - Performance index of one package over n traces: its
+ *     average utilization weighted by UTIL_WEIGHT plus its throughput
+ *     relative to AVG_LIBC_THRUPUT, capped at the remaining weight.
+ *     The two halves are returned in *p1 and *p2.
+ */
+static double perf_index(int n, stats_t *stats, double *p1, double *p2)
+{
+	int i;
+	double secs = 0;
+	double ops = 0;
+	double util = 0;
+	double throughput;
+
+	for (i = 0; i < n; i++)
+	{
+		secs += stats[i].secs;
+		ops += stats[i].ops;
+		util += stats[i].util;
+	}
+	throughput = ops / secs;
+
+	*p1 = UTIL_WEIGHT * (util / n);
+	if (throughput > AVG_LIBC_THRUPUT)
+		*p2 = (double)(1.0 - UTIL_WEIGHT);
+	else
+		*p2 = ((double)(1.0 - UTIL_WEIGHT)) * (throughput / AVG_LIBC_THRUPUT);
+	return (*p1 + *p2) * 100.0;
+}
+
 /*
  * app_error - Report an arbitrary application error
  */
@@ -1054,14 +2753,28 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void)
 {
-	fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+	fprintf(stderr, "Usage: mdriver [-hvVadlsLP] [-f <file>] [-t <dir>] [-b <store>] [-H <size>]\n");
+	fprintf(stderr, "               [-j <n>] [-T <n> [-X <pct>]]\n");
+	fprintf(stderr, "               [--json <file>] [--csv <file>] [--baseline <file>]\n");
 	fprintf(stderr, "Options\n");
 	fprintf(stderr, "\t-a         Don't check the team structure.\n");
+	fprintf(stderr, "\t-b <store> Back the heap with malloc (default), mmap or thp.\n");
+	fprintf(stderr, "\t-d         With mmap or thp, decommit pages the heap shrinks away from.\n");
 	fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
 	fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
 	fprintf(stderr, "\t-h         Print this message.\n");
+	fprintf(stderr, "\t-H <size>  Heap size in bytes, K, M or G (default 20M).\n");
+	fprintf(stderr, "\t-j <n>     Evaluate up to n traces at once, in worker processes.\n");
 	fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+	fprintf(stderr, "\t-L         Print percentiles of each call's latency (not with -s).\n");
+	fprintf(stderr, "\t-P         Count hardware events per op with perf_event_open.\n");
+	fprintf(stderr, "\t-s         Stream traces a chunk at a time instead of loading them.\n");
 	fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
+	fprintf(stderr, "\t-T <n>     Replay the traces in n threads sharing one (thread-safe) package.\n");
 	fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
 	fprintf(stderr, "\t-V         Print additional debug info.\n");
+	fprintf(stderr, "\t-X <pct>   With -T, free pct%% of blocks in another thread.\n");
+	fprintf(stderr, "\t--json <file>      Also write the results to <file> as JSON.\n");
+	fprintf(stderr, "\t--csv <file>       Also write the results to <file> as CSV.\n");
+	fprintf(stderr, "\t--baseline <file>  Compare with an earlier --csv; exit 1 on regressions.\n");
 }
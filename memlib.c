@@ -6,6 +6,7 @@
 *             학생의 malloc 패키지 호출을 libc에 있는 시스템의 malloc 패키지와 인터리빙할 수 있기 때문에 필요합니다.
 *
  */
+#define _GNU_SOURCE /* mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -13,14 +14,188 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "memlib.h"
 #include "config.h"
 
+/*
+ * The heap can be split into up to MEM_MAX_ARENAS equal, page-sized
+ * partitions (arenas), each with its own brk.  Arena i occupies
+ * [mem_start_brk + i*mem_arena_size, mem_start_brk + (i+1)*mem_arena_size).
+ * With a single arena (the default) this is the classic one-brk heap.
+ */
+#define MEM_MAX_ARENAS 64
+
+/*
+ * The heap's backing store is chosen with mem_set_backend before
+ * mem_init.  MEM_MALLOC takes it from malloc, as the original lab did.
+ * MEM_MMAP reserves the heap's address space with mmap and
+ * commits it a grain (MEM_COMMIT_GRAIN bytes) at a time as a brk moves
+ * up.  Committed grains normally stay committed, as malloc'd pages
+ * would, so the backends differ only in how the heap is paged.  With
+ * mem_set_decommit, grains lying wholly more than one grain above a brk
+ * that moves down are decommitted again; the one grain of slack keeps a
+ * heap hovering around a grain boundary from faulting pages in and out.
+ * MEM_THP does the same with huge-page grains and MADV_HUGEPAGE, so
+ * the kernel can back the heap with transparent huge pages.  If THP is
+ * unavailable it falls back to MEM_MMAP.  The mmap reservations are
+ * huge-page aligned either way, so the two can be compared directly.
+ */
+#define MEM_COMMIT_GRAIN (64 * 1024)
+#define MEM_HUGE_PAGE (2 * 1024 * 1024)
+
+/*
+ * mem_map hands out page-granular mappings from a separate range of
+ * MAX_MAP bytes (or the heap size, if larger) reserved with mmap at mem_init.  mem_map_pages[i] is the length
+ * in pages of the mapping that starts at page i, 0 for a page that is
+ * not the start of one, and mem_map_used[i] marks every page in use.
+ * Unmapped pages are given back to the system with MADV_DONTNEED, and
+ * mem_remap moves pages with mremap rather than copying them.
+ */
+
 /* private variables */
+static int mem_backend = MEM_MALLOC; /* backing store for the heap */
+static int mem_decommit_on = 0; /* give grains back when a brk moves down? */
+static size_t mem_max_heap = MAX_HEAP; /* heap size in bytes */
+static size_t mem_map_size;  /* bytes in the mem_map range */
+static size_t mem_grain;     /* commit granularity of the mmap backends */
+static unsigned char *mem_committed; /* grain committed? */
 static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static int mem_narenas = 1;  /* number of arenas the heap is split into */
+static size_t mem_arena_size; /* bytes reserved for each arena */
+static char *mem_brk[MEM_MAX_ARENAS];    /* points to last byte of each arena */
+static size_t mem_size;      /* bytes currently in use over all arenas */
+static size_t mem_peak;      /* largest mem_size + mem_mapped since the last reset */
+static char *mem_map_start;  /* first byte of the mem_map range */
+static size_t mem_map_npages;         /* pages in the mem_map range */
+static size_t *mem_map_pages;         /* mapping length at each start page */
+static unsigned char *mem_map_used;   /* page in use? */
+static size_t mem_mapped;    /* bytes currently mapped */
+static pthread_mutex_t mem_lock = PTHREAD_MUTEX_INITIALIZER; /* guards mem_brk and mem_size in mem_sbrk */
+
+/*
+ * mem_set_backend - choose the heap's backing store (MEM_MALLOC,
+ *    MEM_MMAP or MEM_THP).  Takes effect at the next mem_init.
+ */
+void mem_set_backend(int backend)
+{
+    mem_backend = backend;
+}
+
+/*
+ * mem_set_decommit - with the mmap backends, decommit grains the heap
+ *    shrinks away from (on != 0) or keep them (the default).  Takes
+ *    effect at once.
+ */
+void mem_set_decommit(int on)
+{
+    mem_decommit_on = on;
+}
+
+/*
+ * mem_set_max_heap - set the heap size in bytes (MAX_HEAP by default).
+ *    Takes effect at the next mem_init.
+ */
+void mem_set_max_heap(size_t size)
+{
+    mem_max_heap = size;
+}
+
+/*
+ * mem_max_heapsize - return the heap size set for this mem_init
+ */
+size_t mem_max_heapsize(void)
+{
+    return mem_max_heap;
+}
+
+/*
+ * mem_backend_name - describe the backing store actually in use
+ */
+const char *mem_backend_name(void)
+{
+    switch (mem_backend) {
+    case MEM_MMAP:
+	return mem_decommit_on ? "mmap+decommit" : "mmap";
+    case MEM_THP:
+	return mem_decommit_on ? "mmap+thp+decommit" : "mmap+thp";
+    default:
+	return "malloc";
+    }
+}
+
+/*
+ * mem_reserve - reserve mem_max_heap bytes of huge-page aligned address
+ *    space for the heap without committing any of it
+ */
+static char *mem_reserve(void)
+{
+    size_t len = mem_max_heap + MEM_HUGE_PAGE;
+    char *p, *start;
+
+    p = mmap(NULL, len, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (p == MAP_FAILED)
+	return NULL;
+    start = (char *)(((unsigned long)p + MEM_HUGE_PAGE - 1) & ~(unsigned long)(MEM_HUGE_PAGE - 1));
+    if (start > p)
+	munmap(p, start - p);
+    munmap(start + mem_max_heap, (p + len) - (start + mem_max_heap));
+
+    if ((mem_committed = calloc(mem_max_heap / MEM_COMMIT_GRAIN + 1, 1)) == NULL)
+	return NULL;
+    mem_grain = MEM_COMMIT_GRAIN;
+    if (mem_backend == MEM_THP) {
+	if (madvise(start, mem_max_heap, MADV_HUGEPAGE) == 0)
+	    mem_grain = MEM_HUGE_PAGE;
+	else {
+	    fprintf(stderr, "mem_init: transparent huge pages unavailable, using base pages\n");
+	    mem_backend = MEM_MMAP;
+	}
+    }
+    return start;
+}
+
+/*
+ * mem_commit - make the heap bytes [lo, hi) usable, a grain at a time.
+ *    Returns -1 if the system refuses.  Called with mem_lock held.
+ */
+static int mem_commit(char *lo, char *hi)
+{
+    size_t g = (lo - mem_start_brk) / mem_grain;
+    size_t end = (hi - mem_start_brk + mem_grain - 1) / mem_grain;
+    size_t len;
+
+    for (; g < end; g++) {
+	if (mem_committed[g])
+	    continue;
+	len = (g + 1) * mem_grain > mem_max_heap ? mem_max_heap - g * mem_grain : mem_grain;
+	if (mprotect(mem_start_brk + g * mem_grain, len, PROT_READ | PROT_WRITE) != 0)
+	    return -1;
+	mem_committed[g] = 1;
+    }
+    return 0;
+}
+
+/*
+ * mem_decommit - give back every committed grain lying wholly inside
+ *    the heap bytes [lo, hi).  Called with mem_lock held.
+ */
+static void mem_decommit(char *lo, char *hi)
+{
+    size_t g = (lo - mem_start_brk + mem_grain - 1) / mem_grain;
+    size_t end = (hi - mem_start_brk) / mem_grain;
+    size_t len;
+
+    for (; g < end; g++) {
+	if (!mem_committed[g])
+	    continue;
+	len = (g + 1) * mem_grain > mem_max_heap ? mem_max_heap - g * mem_grain : mem_grain;
+	madvise(mem_start_brk + g * mem_grain, len, MADV_DONTNEED);
+	mprotect(mem_start_brk + g * mem_grain, len, PROT_NONE);
+	mem_committed[g] = 0;
+    }
+}
 
 /* 
  * mem_init - initialize the memory system model
@@ -33,15 +208,33 @@ void mem_init(void)
     */
 
     //예외처리 / 할당했는데 NULL이면 종료
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) { //
-	fprintf(stderr, "mem_init_vm: malloc error\n");
+    if (mem_backend == MEM_MALLOC) {
+	if ((mem_start_brk = (char *)malloc(mem_max_heap)) == NULL) { //
+	    fprintf(stderr, "mem_init_vm: malloc error\n");
+	    exit(1);
+	}
+    } else if ((mem_start_brk = mem_reserve()) == NULL) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
+	exit(1);
+    }
+
+    /* reserve the mem_map range; pages are only committed when touched */
+    mem_map_size = (mem_max_heap > MAX_MAP) ? mem_max_heap : MAX_MAP;
+    mem_map_start = mmap(NULL, mem_map_size, PROT_READ | PROT_WRITE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    mem_map_npages = mem_map_size / mem_pagesize();
+    mem_map_pages = calloc(mem_map_npages, sizeof(size_t));
+    mem_map_used = calloc(mem_map_npages, 1);
+    if (mem_map_start == MAP_FAILED || mem_map_pages == NULL || mem_map_used == NULL) {
+	fprintf(stderr, "mem_init_vm: mmap error\n");
 	exit(1);
     }
 
     //최대 주소니까 시작 주소 + 최대 크기
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
+    mem_narenas = 1;
+    mem_arena_size = mem_max_heap;  /* one arena spans the whole heap */
     //초기화 하는 거니까 brk가 시작 주소랑 같음
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    mem_reset_brk();            /* heap is empty initially */
 }
 
 /* 
@@ -50,7 +243,14 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    if (mem_backend == MEM_MALLOC)
+	free(mem_start_brk);
+    else
+	munmap(mem_start_brk, mem_max_heap);
+    free(mem_committed);
+    munmap(mem_map_start, mem_map_size);
+    free(mem_map_pages);
+    free(mem_map_used);
 }
 
 /*
@@ -59,33 +259,92 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    int i;
+
+    /* committed grains stay committed, as malloc'd pages would */
+    for (i = 0; i < mem_narenas; i++)
+	mem_brk[i] = mem_start_brk + i * mem_arena_size;
+    mem_size = 0;
+    mem_peak = 0;
+
+    /* every mapping goes too */
+    if (mem_mapped > 0) {
+	madvise(mem_map_start, mem_map_size, MADV_DONTNEED);
+	memset(mem_map_pages, 0, mem_map_npages * sizeof(size_t));
+	memset(mem_map_used, 0, mem_map_npages);
+	mem_mapped = 0;
+    }
+}
+
+/*
+ * mem_set_arenas - split the heap into n independent arenas of equal,
+ *    page-aligned size and empty all of them.  n = 1 restores the
+ *    single-brk heap.
+ */
+void mem_set_arenas(int n)
+{
+    if (n < 1)
+	n = 1;
+    if (n > MEM_MAX_ARENAS)
+	n = MEM_MAX_ARENAS;
+    mem_narenas = n;
+    mem_arena_size = (n == 1) ? mem_max_heap
+	: (mem_max_heap / n) & ~(mem_pagesize() - 1);
+    mem_reset_brk();
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area.  A
+ *    negative incr shrinks the heap by -incr bytes, down to empty, and
+ *    returns the old brk.
  *    sbrk 함수의 간단한 모델입니다. 힙을 incr 바이트만큼 확장하고 새 영역의 시작 주소를 반환합니다.
- *    이 모델에서는 힙을 축소할 수 없습니다.
+ *    incr가 음수이면 힙을 -incr 바이트만큼 축소합니다.
+ *    Safe to call from several threads at once.  Extends arena 0.
+ */
+void *mem_sbrk(intptr_t incr) 
+{
+    void *p = mem_arena_sbrk(0, incr);
+
+    if (p == (void *)-1)
+	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+    return p;
+}
+
+/*
+ * mem_arena_sbrk - mem_sbrk for one arena of a partitioned heap.  Fails
+ *    quietly, so a caller can fall back to another arena.
  */
-void *mem_sbrk(int incr) 
+void *mem_arena_sbrk(int arena, intptr_t incr)
 {
+    char *old_brk;
+    char *min_addr = mem_start_brk + arena * mem_arena_size;
+    char *max_addr = min_addr + mem_arena_size;
+
+    pthread_mutex_lock(&mem_lock);
     //확장하기 전에 brk 값 저장!
-    char *old_brk = mem_brk;
+    old_brk = mem_brk[arena];
 
     //예외처리
-    //(incr < 0) 음수 or  mem_max_addr 최대 크기를 초과하면
-    if ( (incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-	errno = ENOMEM; //에러 변수에 담고 에러 메시지 출력
-	fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+    //힙 시작 아래로 줄이거나 max_addr 최대 크기를 초과하면
+    //(mmap 백엔드에서는 커밋에 실패해도)
+    if ( ((old_brk + incr) < min_addr) || ((old_brk + incr) > max_addr) ||
+	 (mem_backend != MEM_MALLOC && incr > 0 && mem_commit(old_brk, old_brk + incr) < 0)) {
+	pthread_mutex_unlock(&mem_lock);
+	errno = ENOMEM; //에러 변수에 담기 (메시지는 mem_sbrk가 출력)
 
     //확장에 실패했으므로 -1 리턴!
 	return (void *)-1;
     }
 
     //brk에 확장하는 값 추가
-    mem_brk += incr;
+    mem_brk[arena] += incr;
+    if (mem_backend != MEM_MALLOC && incr < 0 && mem_decommit_on)
+	mem_decommit(mem_brk[arena] + mem_grain, max_addr);
+    mem_size += incr;
+    if (mem_size + mem_mapped > mem_peak)
+	mem_peak = mem_size + mem_mapped;
+    pthread_mutex_unlock(&mem_lock);
     //예전 brk 리턴하기 왜?
     //사용한 게 아니라 늘리기만 한 거라 마지막으로 사용한 brk 리턴
     return (void *)old_brk;
@@ -110,7 +369,29 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    char *hi = mem_brk[0];
+    int i;
+
+    for (i = 1; i < mem_narenas; i++)
+	if (mem_brk[i] > mem_start_brk + i * mem_arena_size && mem_brk[i] > hi)
+	    hi = mem_brk[i];
+    return (void *)(hi - 1);
+}
+
+/*
+ * mem_arena_hi - return address of the last byte of one arena
+ */
+void *mem_arena_hi(int arena)
+{
+    return (void *)(mem_brk[arena] - 1);
+}
+
+/*
+ * mem_arena_id - return the arena that address p lies in
+ */
+int mem_arena_id(void *p)
+{
+    return (int)(((char *)p - mem_start_brk) / mem_arena_size);
 }
 
 /*
@@ -119,7 +400,25 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return mem_size;
+}
+
+/*
+ * mem_peak_heapsize() - returns the largest heap size in bytes since the
+ *    last mem_reset_brk, counting mem_map mappings as part of the heap.
+    마지막 리셋 이후 가장 컸던 힙 크기(매핑 포함)를 반환합니다.
+ */
+size_t mem_peak_heapsize()
+{
+    return mem_peak;
+}
+
+/*
+ * mem_mapsize() - returns the bytes currently mapped with mem_map
+ */
+size_t mem_mapsize()
+{
+    return mem_mapped;
 }
 
 /*
@@ -130,3 +429,152 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_map_find - first fit over the mem_map range: return the first
+ *    page of a run of npages unused pages, or mem_map_npages if none.
+ *    Called with mem_lock held.
+ */
+static size_t mem_map_find(size_t npages)
+{
+    size_t i, run = 0;
+
+    for (i = 0; i < mem_map_npages; i++) {
+	run = mem_map_used[i] ? 0 : run + 1;
+	if (run == npages)
+	    return i + 1 - npages;
+    }
+    return mem_map_npages;
+}
+
+/*
+ * mem_map_mark - mark npages pages from page first as used or unused
+ *    and account for them.  Called with mem_lock held.
+ */
+static void mem_map_mark(size_t first, size_t npages, int used)
+{
+    size_t bytes = npages * mem_pagesize();
+
+    memset(mem_map_used + first, used, npages);
+    if (used) {
+	mem_mapped += bytes;
+	if (mem_size + mem_mapped > mem_peak)
+	    mem_peak = mem_size + mem_mapped;
+    } else {
+	mem_mapped -= bytes;
+	madvise(mem_map_start + first * mem_pagesize(), bytes, MADV_DONTNEED);
+    }
+}
+
+/*
+ * mem_map - simple model of an anonymous mmap.  Returns size bytes,
+ *    rounded up to whole pages, of zeroed, page-aligned memory outside
+ *    the sbrk heap, or (void *)-1 if the mem_map range is full.
+ *    Safe to call from several threads at once.
+ */
+void *mem_map(size_t size)
+{
+    size_t npages = (size + mem_pagesize() - 1) / mem_pagesize();
+    size_t first;
+
+    pthread_mutex_lock(&mem_lock);
+    if (npages == 0 || (first = mem_map_find(npages)) == mem_map_npages) {
+	pthread_mutex_unlock(&mem_lock);
+	errno = ENOMEM;
+	return (void *)-1;
+    }
+    mem_map_pages[first] = npages;
+    mem_map_mark(first, npages, 1);
+    pthread_mutex_unlock(&mem_lock);
+    return (void *)(mem_map_start + first * mem_pagesize());
+}
+
+/*
+ * mem_unmap - release a mapping returned by mem_map or mem_remap.  Its
+ *    pages go back to the system at once.
+ */
+void mem_unmap(void *p)
+{
+    size_t first = ((char *)p - mem_map_start) / mem_pagesize();
+
+    pthread_mutex_lock(&mem_lock);
+    mem_map_mark(first, mem_map_pages[first], 0);
+    mem_map_pages[first] = 0;
+    pthread_mutex_unlock(&mem_lock);
+}
+
+/*
+ * mem_remap - resize a mapping to size bytes (rounded up to whole pages)
+ *    and return its new address, or (void *)-1 with the mapping left
+ *    alone if it cannot be done.  A mapping shrinks or grows in place
+ *    when it can; otherwise its pages are moved with mremap, so the
+ *    contents are only copied if mremap cannot move them.
+ */
+void *mem_remap(void *p, size_t size)
+{
+    size_t pagesize = mem_pagesize();
+    size_t first = ((char *)p - mem_map_start) / pagesize;
+    size_t newn = (size + pagesize - 1) / pagesize;
+    size_t oldn, i, dst;
+
+    if (newn == 0)
+	return (void *)-1;
+
+    pthread_mutex_lock(&mem_lock);
+    oldn = mem_map_pages[first];
+    if (newn <= oldn) {
+	if (newn < oldn)
+	    mem_map_mark(first + newn, oldn - newn, 0);
+	mem_map_pages[first] = newn;
+	pthread_mutex_unlock(&mem_lock);
+	return p;
+    }
+
+    /* grow in place if the pages right after the mapping are free */
+    for (i = first + oldn; i < first + newn && i < mem_map_npages; i++)
+	if (mem_map_used[i])
+	    break;
+    if (i == first + newn) {
+	mem_map_mark(first + oldn, newn - oldn, 1);
+	mem_map_pages[first] = newn;
+	pthread_mutex_unlock(&mem_lock);
+	return p;
+    }
+
+    if ((dst = mem_map_find(newn)) == mem_map_npages) {
+	pthread_mutex_unlock(&mem_lock);
+	errno = ENOMEM;
+	return (void *)-1;
+    }
+
+    /* move the pages over, then put fresh reserved pages back where they were */
+    if (mremap(p, oldn * pagesize, newn * pagesize, MREMAP_MAYMOVE | MREMAP_FIXED,
+	       mem_map_start + dst * pagesize) == MAP_FAILED) {
+	/* earlier moves can leave the pages split across kernel mappings,
+	   which mremap will not move as one: copy them instead */
+	memcpy(mem_map_start + dst * pagesize, p, oldn * pagesize);
+	madvise(p, oldn * pagesize, MADV_DONTNEED);
+    } else if (mmap(p, oldn * pagesize, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED) {
+	fprintf(stderr, "mem_remap: mmap error\n");
+	exit(1);
+    }
+    mem_map_pages[first] = 0;
+    memset(mem_map_used + first, 0, oldn);
+    mem_mapped -= oldn * pagesize;
+    mem_map_pages[dst] = newn;
+    mem_map_mark(dst, newn, 1);
+    pthread_mutex_unlock(&mem_lock);
+    return (void *)(mem_map_start + dst * pagesize);
+}
+
+/*
+ * mem_is_mapped - is p inside a live mem_map mapping?
+ */
+int mem_is_mapped(void *p)
+{
+    char *c = (char *)p;
+
+    return c >= mem_map_start && c < mem_map_start + mem_map_npages * mem_pagesize()
+	&& mem_map_used[(c - mem_map_start) / mem_pagesize()];
+}
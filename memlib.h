@@ -1,11 +1,34 @@
 #include <unistd.h>
+#include <stdint.h>
 
+/* Backing stores for the simulated heap, see mem_set_backend */
+#define MEM_MALLOC 0
+#define MEM_MMAP 1
+#define MEM_THP 2
+
+void mem_set_backend(int backend);
+void mem_set_decommit(int on);
+void mem_set_max_heap(size_t size);
+size_t mem_max_heapsize(void);
+const char *mem_backend_name(void);
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
 size_t mem_pagesize(void);
 
+void mem_set_arenas(int n);
+void *mem_arena_sbrk(int arena, intptr_t incr);
+void *mem_arena_hi(int arena);
+int mem_arena_id(void *p);
+
+void *mem_map(size_t size);
+void mem_unmap(void *p);
+void *mem_remap(void *p, size_t size);
+int mem_is_mapped(void *p);
+size_t mem_mapsize(void);
+
@@ -1,14 +1,18 @@
 /*
- * mm-naive.c - The fastest, least memory-efficient malloc package.
+ * mm_explicit.c - Explicit free list allocator.
  *
- * In this naive approach, a block is allocated by simply incrementing
- * the brk pointer.  A block is pure payload. There are no headers or
- * footers.  Blocks are never coalesced or reused. Realloc is
- * implemented directly using mm_malloc and mm_free.
-
-
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a high level description of your solution.
+ * Blocks use the same boundary-tag format as mm_first.c: a 4-byte
+ * header and footer holding the block size and the allocated bit.
+ * Free blocks additionally store a predecessor and a successor pointer
+ * at the start of their payload, threading every free block into one
+ * doubly-linked list (LIFO order).  find_fit walks only this list, so
+ * the cost of an allocation depends on the number of free blocks rather
+ * than on the total number of blocks in the heap.
+ *
+ * The list is maintained by three routines:
+ *   extend_heap - the new chunk is pushed through coalesce
+ *   coalesce    - neighbours are unlinked, the merged block is pushed
+ *   place       - the chosen block is unlinked, a split remainder is pushed
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -25,11 +29,11 @@
  ********************************************************/
 team_t team = {
     /* Team name */
-    "ateam",
+    "team",
     /* First member's full name */
-    "Harry Bovik",
+    "kim ",
     /* First member's email address */
-    "bovik@cs.cmu.edu",
+    "9",
     /* Second member's full name (leave blank if none) */
     "",
     /* Second member's email address (leave blank if none) */
@@ -60,12 +64,22 @@ team_t team = {
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+/* Free list links live in the first two pointer slots of the payload */
+#define PRED_FREEP(bp) (*(char **)(bp))
+#define SUCC_FREEP(bp) (*(char **)((char *)(bp) + sizeof(char *)))
+
+/* Smallest block that can hold a header, footer and both links */
+#define MINBLOCKSIZE (ALIGN(DSIZE + 2 * sizeof(char *)))
+
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
+static void insert_free_block(void *bp);
+static void remove_free_block(void *bp);
 
 static char *heap_listp = NULL;
+static char *free_listp = NULL;
 
 int mm_init(void)
 {
@@ -81,9 +95,9 @@ int mm_init(void)
     PUT(heap_listp + (3 * WSIZE), PACK(0, 1));
 
     heap_listp += (2 * WSIZE);
+    free_listp = NULL;
 
     if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
-    //if (extend_heap(4) == NULL)
     {
         return -1;
     }
@@ -111,44 +125,75 @@ static void *extend_heap(size_t words)
     return coalesce(bp);
 }
 
-void *coalesce(void *bp)
+/*
+ * insert_free_block - Push bp onto the front of the free list
+ */
+static void insert_free_block(void *bp)
+{
+    PRED_FREEP(bp) = NULL;
+    SUCC_FREEP(bp) = free_listp;
+    if (free_listp != NULL)
+    {
+        PRED_FREEP(free_listp) = bp;
+    }
+    free_listp = bp;
+}
+
+/*
+ * remove_free_block - Unlink bp from the free list
+ */
+static void remove_free_block(void *bp)
 {
-    size_t prev_alloc;
-    if ((char *)bp == heap_listp)
+    if (PRED_FREEP(bp) != NULL)
     {
-        prev_alloc = 1;
+        SUCC_FREEP(PRED_FREEP(bp)) = SUCC_FREEP(bp);
     }
     else
     {
-        prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
+        free_listp = SUCC_FREEP(bp);
     }
+    if (SUCC_FREEP(bp) != NULL)
+    {
+        PRED_FREEP(SUCC_FREEP(bp)) = PRED_FREEP(bp);
+    }
+}
+
+/*
+ * coalesce - Merge bp with its free neighbours and put the result on
+ *     the free list.  bp itself must not be on the list yet.
+ */
+static void *coalesce(void *bp)
+{
+    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
-    if (prev_alloc && next_alloc)
-    {
-        return bp;
-    }
-    else if (prev_alloc && !next_alloc)
+    if (prev_alloc && !next_alloc)
     {
+        remove_free_block(NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(HDRP(bp), PACK(size, 0));
         PUT(FTRP(bp), PACK(size, 0));
     }
     else if (!prev_alloc && next_alloc)
     {
+        remove_free_block(PREV_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp)));
         PUT(FTRP(bp), PACK(size, 0));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
     }
-    else
+    else if (!prev_alloc && !next_alloc)
     {
+        remove_free_block(PREV_BLKP(bp));
+        remove_free_block(NEXT_BLKP(bp));
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
     }
+
+    insert_free_block(bp);
     return bp;
 }
 
@@ -161,10 +206,7 @@ void *mm_malloc(size_t size)
     if (size == 0)
         return NULL;
 
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    asize = MAX(MINBLOCKSIZE, ALIGN(size + DSIZE));
 
     if ((bp = find_fit(asize)) != NULL)
     {
@@ -202,12 +244,7 @@ void *mm_realloc(void *bp, size_t size)
     }
 
     size_t oldsize = GET_SIZE(HDRP(bp));
-    size_t asize;
-
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    size_t asize = MAX(MINBLOCKSIZE, ALIGN(size + DSIZE));
 
     if (asize == oldsize)
         return bp;
@@ -225,13 +262,16 @@ void *mm_realloc(void *bp, size_t size)
     return new_bp;
 }
 
+/*
+ * find_fit - First fit over the free list only
+ */
 static void *find_fit(size_t asize)
 {
-    void *bp;
+    char *bp;
 
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    for (bp = free_listp; bp != NULL; bp = SUCC_FREEP(bp))
     {
-        if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
+        if (asize <= GET_SIZE(HDRP(bp)))
         {
             return bp;
         }
@@ -243,17 +283,20 @@ static void place(void *bp, size_t asize)
 {
     size_t csize = GET_SIZE(HDRP(bp));
 
-    if ((csize - asize) >= (2 * DSIZE))
+    remove_free_block(bp);
+
+    if ((csize - asize) >= MINBLOCKSIZE)
     {
         PUT(HDRP(bp), PACK(asize, 1));
         PUT(FTRP(bp), PACK(asize, 1));
         bp = NEXT_BLKP(bp);
         PUT(HDRP(bp), PACK(csize - asize, 0));
         PUT(FTRP(bp), PACK(csize - asize, 0));
+        insert_free_block(bp);
     }
     else
     {
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
     }
-}
\ No newline at end of file
+}
@@ -1,14 +1,29 @@
 /*
- * mm-naive.c - The fastest, least memory-efficient malloc package.
+ * mm_implicit.c - Implicit free list allocator with a compile-time
+ *     placement policy.
  *
- * In this naive approach, a block is allocated by simply incrementing
- * the brk pointer.  A block is pure payload. There are no headers or
- * footers.  Blocks are never coalesced or reused. Realloc is
- * implemented directly using mm_malloc and mm_free.
-
-
- * NOTE TO STUDENTS: Replace this header comment with your own header
- * comment that gives a high level description of your solution.
+ * Blocks carry a 4-byte header and footer holding the block size and the
+ * allocated bit, and find_fit walks every block in the heap.  What
+ * differs between the classic textbook variants is chosen when the file
+ * is compiled, so each variant is its own object with no runtime
+ * dispatch:
+ *
+ *   MM_FIT        placement policy (default FIT_FIRST)
+ *                   FIT_FIRST  first free block that fits
+ *                   FIT_NEXT   first fit, resuming where the last search
+ *                              stopped (the rover)
+ *                   FIT_BEST   smallest free block that fits, stopping
+ *                              early on an exact fit
+ *                   FIT_GOOD   best of the first MM_GOOD_SEARCH blocks
+ *                              that fit
+ *   MM_SPLIT_MIN  smallest remainder place splits off as a free block
+ *                 (default 2 * DSIZE, the smallest legal block)
+ *   MM_CHUNKSIZE  bytes the heap grows by when nothing fits
+ *                 (default 4096)
+ *
+ * e.g. gcc -DMM_FIT=FIT_GOOD -DMM_GOOD_SEARCH=4 -c mm_implicit.c.  The
+ * Makefile builds one driver per policy (mdriver-first, mdriver-next,
+ * mdriver-best, mdriver-good).
  */
 #include <stdio.h>
 #include <stdlib.h>
@@ -19,6 +34,19 @@
 #include "mm.h"
 #include "memlib.h"
 
+#define FIT_FIRST 0
+#define FIT_NEXT 1
+#define FIT_BEST 2
+#define FIT_GOOD 3
+
+#ifndef MM_FIT
+#define MM_FIT FIT_FIRST
+#endif
+
+#ifndef MM_GOOD_SEARCH
+#define MM_GOOD_SEARCH 8
+#endif
+
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in the following struct.
@@ -37,7 +65,15 @@ team_t team = {
 
 #define WSIZE 4
 #define DSIZE 8
-#define CHUNKSIZE (1 << 12)
+
+#ifndef MM_CHUNKSIZE
+#define MM_CHUNKSIZE (1 << 12)
+#endif
+#define CHUNKSIZE MM_CHUNKSIZE
+
+#ifndef MM_SPLIT_MIN
+#define MM_SPLIT_MIN (2 * DSIZE)
+#endif
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
 #define PACK(size, alloc) ((size) | (alloc))
@@ -60,13 +96,18 @@ team_t team = {
 
 #define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
 
+/* Block size for a request: header + footer + payload, at least 2*DSIZE */
+#define ASIZE(size) (((size) <= DSIZE) ? 2 * DSIZE : ALIGN((size) + DSIZE))
+
 static void *coalesce(void *bp);
 static void *extend_heap(size_t words);
 static void *find_fit(size_t asize);
 static void place(void *bp, size_t asize);
 
 static char *heap_listp = NULL;
-static char *last_fitp;
+#if MM_FIT == FIT_NEXT
+static char *rover = NULL; /* where the next search starts */
+#endif
 
 int mm_init(void)
 {
@@ -82,10 +123,11 @@ int mm_init(void)
     PUT(heap_listp + (3 * WSIZE), PACK(0, 1));
 
     heap_listp += (2 * WSIZE);
-    last_fitp = heap_listp;
+#if MM_FIT == FIT_NEXT
+    rover = heap_listp;
+#endif
 
-    //if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
-    if (extend_heap(4) == NULL)
+    if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
     {
         return -1;
     }
@@ -113,25 +155,13 @@ static void *extend_heap(size_t words)
     return coalesce(bp);
 }
 
-void *coalesce(void *bp)
+static void *coalesce(void *bp)
 {
-    size_t prev_alloc;
-    if ((char *)bp == heap_listp)
-    {
-        prev_alloc = 1;
-    }
-    else
-    {
-        prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
-    }
+    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp)));
     size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
     size_t size = GET_SIZE(HDRP(bp));
 
-    if (prev_alloc && next_alloc)
-    {
-        return bp;
-    }
-    else if (prev_alloc && !next_alloc)
+    if (prev_alloc && !next_alloc)
     {
         size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
         PUT(HDRP(bp), PACK(size, 0));
@@ -144,7 +174,7 @@ void *coalesce(void *bp)
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
         bp = PREV_BLKP(bp);
     }
-    else
+    else if (!prev_alloc && !next_alloc)
     {
         size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
         PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
@@ -152,7 +182,11 @@ void *coalesce(void *bp)
         bp = PREV_BLKP(bp);
     }
 
-    last_fitp = bp;
+#if MM_FIT == FIT_NEXT
+    /* The rover must not be left pointing into the middle of bp */
+    if (rover > (char *)bp && rover < NEXT_BLKP(bp))
+        rover = bp;
+#endif
     return bp;
 }
 
@@ -165,21 +199,17 @@ void *mm_malloc(size_t size)
     if (size == 0)
         return NULL;
 
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
+    asize = ASIZE(size);
 
-    bp = find_fit(asize);
-    if (bp != NULL && GET_SIZE(HDRP(bp)) >= asize) {
+    if ((bp = find_fit(asize)) != NULL)
+    {
         place(bp, asize);
         return bp;
     }
 
     extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL){
+    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
         return NULL;
-    }
     place(bp, asize);
     return bp;
 }
@@ -207,14 +237,8 @@ void *mm_realloc(void *bp, size_t size)
     }
 
     size_t oldsize = GET_SIZE(HDRP(bp));
-    size_t asize;
 
-    if (size <= DSIZE)
-        asize = 2 * DSIZE;
-    else
-        asize = DSIZE * ((size + (DSIZE) + (DSIZE - 1)) / DSIZE);
-
-    if (asize == oldsize)
+    if (ASIZE(size) == oldsize)
         return bp;
 
     void *new_bp = mm_malloc(size);
@@ -224,56 +248,103 @@ void *mm_realloc(void *bp, size_t size)
     size_t copySize = oldsize - DSIZE;
     if (size < copySize)
         copySize = size;
-    if (new_bp != bp) {
-        memcpy(new_bp, bp, copySize);
-        mm_free(bp);
-    }
+    memcpy(new_bp, bp, copySize);
+
+    mm_free(bp);
     return new_bp;
 }
 
+#if MM_FIT == FIT_FIRST
+
 static void *find_fit(size_t asize)
 {
-    char *p = last_fitp;
-    int count = 0;
+    char *bp;
 
-    while (GET_SIZE(HDRP(p)) > 0)
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
     {
-        if (!GET_ALLOC(HDRP(p)) && GET_SIZE(HDRP(p)) >= asize)
+        if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
         {
-            last_fitp = p;
-            return p;
+            return bp;
         }
-
-        p = NEXT_BLKP(p);
     }
+    return NULL;
+}
 
-    p = heap_listp;
+#elif MM_FIT == FIT_NEXT
 
-    while (p < last_fitp)
+/*
+ * find_fit - First fit from the rover to the end of the heap, then from
+ *     the start of the heap back up to the rover
+ */
+static void *find_fit(size_t asize)
+{
+    char *bp;
+
+    for (bp = rover; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
     {
-        if (!GET_ALLOC(HDRP(p)) && GET_SIZE(HDRP(p)) >= asize)
+        if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
         {
-            last_fitp = p;
-            return p;
+            rover = bp;
+            return bp;
+        }
+    }
+    for (bp = heap_listp; bp < rover; bp = NEXT_BLKP(bp))
+    {
+        if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))))
+        {
+            rover = bp;
+            return bp;
         }
-
-        p = NEXT_BLKP(p);
     }
-
     return NULL;
 }
 
-static void place(void *bp, size_t asize)
+#elif MM_FIT == FIT_BEST || MM_FIT == FIT_GOOD
+
+/*
+ * find_fit - Smallest fitting block, over the whole heap (FIT_BEST) or
+ *     over the first MM_GOOD_SEARCH fitting blocks (FIT_GOOD).  An exact
+ *     fit ends the search either way.
+ */
+static void *find_fit(size_t asize)
 {
+    char *bp;
+    char *best = NULL;
+    size_t best_size = 0;
+#if MM_FIT == FIT_GOOD
+    int seen = 0;
+#endif
 
-    if (bp == NULL || GET_SIZE(HDRP(bp)) == 0)
+    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
     {
-        return;
+        size_t bsize = GET_SIZE(HDRP(bp));
+
+        if (GET_ALLOC(HDRP(bp)) || bsize < asize)
+            continue;
+        if (best == NULL || bsize < best_size)
+        {
+            best = bp;
+            best_size = bsize;
+            if (bsize == asize)
+                break;
+        }
+#if MM_FIT == FIT_GOOD
+        if (++seen >= MM_GOOD_SEARCH)
+            break;
+#endif
     }
+    return best;
+}
 
+#else
+#error "MM_FIT must be FIT_FIRST, FIT_NEXT, FIT_BEST or FIT_GOOD"
+#endif
+
+static void place(void *bp, size_t asize)
+{
     size_t csize = GET_SIZE(HDRP(bp));
 
-    if ((csize - asize) >= (2 * DSIZE))
+    if ((csize - asize) >= MAX(MM_SPLIT_MIN, 2 * DSIZE))
     {
         PUT(HDRP(bp), PACK(asize, 1));
         PUT(FTRP(bp), PACK(asize, 1));
@@ -286,6 +357,4 @@ static void place(void *bp, size_t asize)
         PUT(HDRP(bp), PACK(csize, 1));
         PUT(FTRP(bp), PACK(csize, 1));
     }
-
-    last_fitp = bp;
-}
\ No newline at end of file
+}
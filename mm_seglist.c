@@ -0,0 +1,1590 @@
+/*
+ * mm_seglist.c - Segregated-fit allocator.
+ *
+ * Every block has a one-word header holding the block size, the
+ * allocated bit (bit 0) and the allocated status of the previous block
+ * (bit 1, PREV_ALLOC).  A word is 4 bytes, which limits blocks to 4GB,
+ * so mm_init refuses a larger heap; built with -DMM_64BIT=1 it is a
+ * size_t instead.  Only free blocks carry a footer; allocated blocks
+ * give that word to the payload.  coalesce reads the previous block's
+ * status from the PREV_ALLOC bit and only follows the previous block's
+ * footer when that block is known to be free.  mm_free, place and
+ * extend_heap keep the bit of the following block up to date.  Free
+ * blocks carry predecessor/successor links in their payload as in
+ * mm_explicit.c.
+ *
+ * Instead of one free list there is an array of NUM_CLASSES lists,
+ * one per power-of-two size class: class i holds the free blocks whose
+ * size lies in [2^(i+4), 2^(i+5)), and the last class is open-ended.
+ *
+ * The list heads are stored in the payload of the prologue block that
+ * mm_init lays down, so the heap is self-describing:
+ *
+ *   | pad | prologue hdr | list heads | tree root+nil | run heads | prologue ftr | blocks ... | epilogue hdr |
+ *
+ * get_class maps a size to its class with a single bit scan, and
+ * find_fit searches the request's own class first and only moves on to
+ * larger classes when that class has nothing big enough.  Searching the
+ * smallest class that can hold the request approximates best fit.
+ *
+ * Free blocks of TREE_MIN_SIZE bytes or more are not kept on a list at
+ * all.  They are indexed in a red-black tree keyed by (size, address),
+ * whose left/right/parent links and colour are embedded in the free
+ * block's payload.  tree_find_fit returns the smallest block that is at
+ * least as large as the request (exact best fit) in O(log n).  The
+ * tree's root and its black sentinel node sit in the prologue payload
+ * right after the list heads.  Because insert_free_block and
+ * remove_free_block dispatch on size, coalesce and place keep the tree
+ * consistent without knowing about it.
+ *
+ * mm_realloc works in place whenever it can.  A shrinking block gives
+ * its tail back as a free block.  A growing block absorbs a free
+ * successor, and a block at the top of the heap asks mem_sbrk only for
+ * the missing bytes.  It falls back to malloc + copy + free only when
+ * neither applies.
+ *
+ * Blocks that mm_realloc has already grown once are tagged with bit 2 of
+ * the header (REALLOC_TAG).  A tagged block that grows again is given
+ * RESERVE(asize) bytes, half again what was asked for, so that later
+ * growth fills the reserve without moving or copying.  A tagged request
+ * that no longer needs the reserve (the block would exceed RESERVE of
+ * the new size) is treated as a shrink: the tail goes back to the free
+ * lists and the tag is cleared.  mm_free, place and coalesce rewrite
+ * headers without the tag, so a freed reserve is reclaimed like any other
+ * free space.
+ *
+ * Requests of at most SLAB_MAX bytes never reach the boundary-tag heap.
+ * They are served from runs: RUN_SIZE-byte, page-aligned regions, each
+ * holding equal slots of one multiple of ALIGNMENT.  A run is an
+ * ordinary allocated block to the rest of the heap, whose payload
+ * starts on a page boundary.  Its run_t header at the start of the page
+ * keeps a bitmap of free slots, and the slots themselves carry no header
+ * at all.  mm_free recognises a slot by looking up its page in run_map
+ * and finds the run by masking the pointer down to the page boundary.
+ * Runs with a free slot are kept on a per-class list whose heads sit in
+ * the prologue.  A run that becomes completely empty goes back to the
+ * heap, unless it is the last run of its class.
+ *
+ * Requests of MM_MAP_THRESHOLD bytes or more bypass the heap entirely.
+ * Each gets its own page-granular mapping from mem_map, laid out as
+ * | pad | hdr | payload ... | with the mapping length in the header.
+ * mm_free hands the mapping straight back with mem_unmap, and
+ * mm_realloc resizes it with mem_remap, which moves pages instead of
+ * copying bytes.  A mapped block stays mapped however small it is
+ * reallocated to.  Once the mem_map range is full, large requests (and
+ * mapped blocks that cannot grow) fall back to the heap like any other.
+ * mem_is_mapped tells mapped blocks apart; it is checked before
+ * anything that assumes bp lies in the sbrk heap.
+ *
+ * The heap shrinks as well as grows.  When mm_free leaves a free block
+ * of TRIM_THRESHOLD bytes or more at the top of the heap (the
+ * wilderness), trim_heap cuts it down to TRIM_KEEP bytes and hands the
+ * rest back with a negative mem_sbrk.  The threshold is large enough
+ * that a heap oscillating around its size does not trim and regrow on
+ * every call.
+ *
+ * Built with MM_THREADS=1 the package is thread-safe.  The heap itself
+ * (everything behind heap_init/heap_malloc/heap_free/heap_realloc) is
+ * guarded by one mutex, heap_lock.  In front of it every thread keeps a
+ * tcache of freed slab slots per class.  mm_malloc and mm_free of small
+ * objects are served from that cache without the lock.  A miss refills
+ * TCACHE_BATCH slots under one lock hold, and a full class flushes
+ * TCACHE_BATCH slots back, so a thread never caches more than TCACHE_MAX
+ * slots per class.  The cache is flushed when its thread exits and
+ * discarded when mm_init builds a new heap.
+ *
+ * With MM_ARENAS=n the memlib heap is split into n arenas (see
+ * mem_set_arenas), each a complete heap with its own prologue, lists,
+ * tree, runs and lock.  heap_listp is thread-local: heap_enter locks an
+ * arena and points heap_listp at its prologue, so every heap_* routine
+ * runs unchanged on whichever arena the thread has entered.  Threads
+ * allocate from their own arena.  A block freed by a thread that does
+ * not own it is pushed onto the owning arena's lock-free remote-free
+ * queue, and the owner frees the queued blocks the next time it enters.
+ * A cross-thread free therefore never touches the owner's lock or
+ * free lists.
+ */
+#define _GNU_SOURCE /* sched_getcpu */
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <unistd.h>
+#include <string.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/* Build with -DMM_64BIT=1 for size_t header words */
+#ifndef MM_64BIT
+#define MM_64BIT 0
+#endif
+
+/*
+ * Build with -DMM_THREADS=1 for the thread-safe version, and with
+ * -DMM_ARENAS=n (n > 1, implies MM_THREADS) to split it into n arenas.
+ * -DMM_ARENA_BY_CPU=1 picks a thread's arena by the CPU it runs on
+ * instead of round-robin.
+ */
+#ifndef MM_ARENAS
+#define MM_ARENAS 1
+#endif
+
+#if MM_ARENAS > 1
+#undef MM_THREADS
+#define MM_THREADS 1
+#endif
+
+#ifndef MM_THREADS
+#define MM_THREADS 0
+#endif
+
+#if MM_THREADS
+#if MM_ARENA_BY_CPU
+#include <sched.h>
+#endif
+#include <pthread.h>
+#endif
+
+/*********************************************************
+ * NOTE TO STUDENTS: Before you do anything else, please
+ * provide your team information in the following struct.
+ ********************************************************/
+team_t team = {
+    /* Team name */
+    "team",
+    /* First member's full name */
+    "kim ",
+    /* First member's email address */
+    "9",
+    /* Second member's full name (leave blank if none) */
+    "",
+    /* Second member's email address (leave blank if none) */
+    ""};
+
+#if MM_64BIT
+#define WORD size_t
+#else
+#define WORD unsigned int
+#endif
+
+#define WSIZE ((int)sizeof(WORD))
+#define DSIZE (2 * WSIZE)
+#define CHUNKSIZE (1 << 12)
+
+#define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define PACK(size, alloc) ((size) | (alloc))
+
+#define GET(p) (*(WORD *)(p))
+#define PUT(p, val) (*(WORD *)(p) = (WORD)(val))
+
+/* Largest request whose block size still fits in a header word */
+#define MAX_REQUEST ((size_t)(WORD)~(WORD)0x7 - DSIZE - ALIGNMENT)
+
+/* Largest heap whose blocks, however they merge, fit in a header word.
+   Mappings are no larger than the heap or MAX_MAP, so they fit too. */
+#define MAX_HEAPSIZE ((size_t)(WORD)~(WORD)0x7)
+
+#define GET_SIZE(p) (GET(p) & ~0x7)
+#define GET_ALLOC(p) (GET(p) & 0x1)
+
+/* Bit 1 of a header records whether the previous block is allocated */
+#define PREV_ALLOC 0x2
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
+
+/* Bit 2 of an allocated block's header marks a block grown by mm_realloc */
+#define REALLOC_TAG 0x4
+#define GET_REALLOC_TAG(p) (GET(p) & REALLOC_TAG)
+#define SET_REALLOC_TAG(p) PUT(p, GET(p) | REALLOC_TAG)
+
+#define HDRP(bp) ((char *)(bp) - WSIZE)
+/* Only meaningful for free blocks */
+#define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
+
+#define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp) - WSIZE)))
+/* Only meaningful when the previous block is free */
+#define PREV_BLKP(bp) ((char *)(bp) - GET_SIZE(((char *)(bp) - DSIZE)))
+
+#define ALIGNMENT 8
+
+#define ALIGN(size) (((size) + (ALIGNMENT - 1)) & ~0x7)
+
+#define SIZE_T_SIZE (ALIGN(sizeof(size_t)))
+
+/* Free list links live in the first two pointer slots of the payload */
+#define PRED_FREEP(bp) (*(char **)(bp))
+#define SUCC_FREEP(bp) (*(char **)((char *)(bp) + sizeof(char *)))
+
+/* Smallest block that can hold a header, footer and both links */
+#define MINBLOCKSIZE (ALIGN(DSIZE + 2 * sizeof(char *)))
+
+/* Block size reserved for a tagged block that grows to asize bytes */
+#define RESERVE(asize) (ALIGN((asize) + (asize) / 2))
+
+/* Requests this large get their own mapping; override with -D */
+#ifndef MM_MAP_THRESHOLD
+#define MM_MAP_THRESHOLD (128 * 1024)
+#endif
+
+/* Bytes of mapping a mapped request of size bytes occupies */
+#define MAP_LEN(size) (((size) + DSIZE + mem_pagesize() - 1) & ~(mem_pagesize() - 1))
+
+/* Payload bytes of mapped block bp */
+#define MAP_PAYLOAD(bp) (GET_SIZE(HDRP(bp)) - DSIZE)
+
+/* A free top block this large is trimmed down to TRIM_KEEP bytes */
+#define TRIM_THRESHOLD (32 * CHUNKSIZE)
+#define TRIM_KEEP CHUNKSIZE
+
+/* Number of size classes; class i starts at 2^(i + MIN_CLASS_SHIFT) bytes */
+#define NUM_CLASSES 4
+#define MIN_CLASS_SHIFT 4
+
+/* Free blocks at least this large go into the tree instead of a list */
+#define TREE_MIN_SIZE (1 << (NUM_CLASSES + MIN_CLASS_SHIFT))
+
+/* Head of the free list for class i, kept in the prologue payload */
+#define SEG_HEAD(i) (*(char **)(heap_listp + (i) * sizeof(char *)))
+
+/* Tree root and sentinel, kept in the prologue payload after the heads */
+#define TREE_ROOT (*(char **)(heap_listp + NUM_CLASSES * sizeof(char *)))
+#define TREE_NIL (heap_listp + (NUM_CLASSES + 1) * sizeof(char *))
+
+/* Tree links and colour of a large free block */
+#define LEFT(bp) (*(char **)(bp))
+#define RIGHT(bp) (*(char **)((char *)(bp) + sizeof(char *)))
+#define PARENT(bp) (*(char **)((char *)(bp) + 2 * sizeof(char *)))
+#define COLOR(bp) (*(unsigned int *)((char *)(bp) + 3 * sizeof(char *)))
+
+#define BLACK 0
+#define RED 1
+
+/* Small-object tier: one run list per multiple of ALIGNMENT up to SLAB_MAX */
+#define SLAB_MAX 64
+#define SLAB_CLASSES (SLAB_MAX / ALIGNMENT)
+#define SLAB_CLASS(size) (((size) - 1) / ALIGNMENT)
+
+#define RUN_SIZE 4096
+#define RUN_BITMAP_WORDS 16
+#define RUN_HDRSIZE (ALIGN(sizeof(run_t)))
+#define RUN_BLOCKSIZE (ALIGN(RUN_SIZE + WSIZE))
+
+/* Head of the run list for slab class i, kept in the prologue payload */
+#define SLAB_HEAD(i) (*(run_t **)(heap_listp + (NUM_CLASSES + 5 + (i)) * sizeof(char *)))
+
+/* The run a slot belongs to, and the slot's page number in run_map */
+#define RUNP(p) ((run_t *)((unsigned long)(p) & ~(unsigned long)(RUN_SIZE - 1)))
+#define RUN_PAGE(p) (((unsigned long)(p) / RUN_SIZE) - ((unsigned long)heap_startp / RUN_SIZE))
+#define IS_RUN(p) (run_map[RUN_PAGE(p)])
+
+/* Header at the start of every run page */
+typedef struct run
+{
+    struct run *next;                      /* next run of this class with a free slot */
+    struct run *prev;                      /* previous run on that list */
+    unsigned int slot_size;                /* payload bytes per slot */
+    unsigned int nslots;                   /* slots in this run */
+    unsigned int nfree;                    /* slots currently free */
+    unsigned int bitmap[RUN_BITMAP_WORDS]; /* bit set = slot free */
+} run_t;
+
+static void *coalesce(void *bp);
+static void *extend_heap(size_t words);
+static void *find_fit(size_t asize);
+static void place(void *bp, size_t asize);
+static void split_tail(void *bp, size_t asize);
+static void trim_heap(void *bp);
+static void *map_alloc(size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
+static void insert_free_block(void *bp);
+static void remove_free_block(void *bp);
+static int get_class(size_t size);
+static void tree_insert(char *z);
+static void tree_delete(char *z);
+static void *tree_find_fit(size_t asize);
+static void *alloc_aligned(size_t asize, size_t align);
+static void *slab_alloc(size_t size);
+static void slab_free(void *bp);
+static int heap_init(void);
+static void *heap_malloc(size_t size);
+static void heap_free(void *bp);
+static void *heap_realloc(void *bp, size_t size);
+static void slab_reset(void);
+
+#if MM_ARENAS > 1
+/* Each thread works on the arena it has entered; see heap_enter */
+#define HEAP_TLS __thread
+#define HEAP_SBRK(incr) mem_arena_sbrk(cur_arena, (incr))
+#define HEAP_HI() mem_arena_hi(cur_arena)
+#else
+#define HEAP_TLS
+#define HEAP_SBRK(incr) mem_sbrk(incr)
+#define HEAP_HI() mem_heap_hi()
+#endif
+
+static HEAP_TLS char *heap_listp = NULL;
+static char *heap_startp = NULL;
+
+/*
+ * One byte per heap page, set when the page is a run.  A byte rather than
+ * a bit, so that mm_free can read its page's entry without the heap lock
+ * while another thread updates a neighbouring page.  Sized by slab_reset
+ * from the heap size memlib was set up with.
+ */
+static unsigned char *run_map = NULL;
+static size_t run_map_size = 0;
+
+#if MM_THREADS
+/* Slots each thread may cache per class, and slots moved per lock hold */
+#define TCACHE_MAX 64
+#define TCACHE_BATCH 16
+
+/* Per-thread cache of free slab slots, linked through their first word */
+typedef struct
+{
+    unsigned long gen;                /* heap_gen the slots belong to */
+    void *head[SLAB_CLASSES];         /* cached slots per slab class */
+    unsigned int count[SLAB_CLASSES]; /* length of each list */
+} tcache_t;
+
+static void tcache_key_create(void);
+
+#if MM_ARENAS == 1
+static pthread_mutex_t heap_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static unsigned long heap_gen = 0; /* bumped by every mm_init */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+static __thread tcache_t tcache;
+
+#if MM_ARENAS > 1
+typedef struct
+{
+    pthread_mutex_t lock; /* guards everything reachable from listp */
+    char *listp;          /* the arena's heap_listp, NULL until first use */
+    void *remote;         /* blocks freed by other threads, linked through their first word */
+} arena_t;
+
+static arena_t arenas[MM_ARENAS];
+#if !MM_ARENA_BY_CPU
+static int next_arena = 0;                /* round-robin assignment counter */
+static __thread int thread_arena = -1;    /* calling thread's arena */
+#endif
+static __thread int cur_arena = 0;        /* arena the thread has entered */
+#endif
+#endif
+
+static int heap_init(void)
+{
+    size_t psize = DSIZE + (NUM_CLASSES + 5 + SLAB_CLASSES) * sizeof(char *);
+    int i;
+
+    if (mem_max_heapsize() > MAX_HEAPSIZE)
+        return -1;
+    if ((heap_listp = HEAP_SBRK(2 * WSIZE + psize)) == ((void *)-1))
+    {
+        return -1;
+    }
+
+    PUT(heap_listp, 0);
+    PUT(heap_listp + (1 * WSIZE), PACK(psize, 1));
+    PUT(heap_listp + psize, PACK(psize, 1));
+    PUT(heap_listp + WSIZE + psize, PACK(0, PREV_ALLOC | 1));
+
+    heap_listp += (2 * WSIZE);
+    for (i = 0; i < NUM_CLASSES; i++)
+    {
+        SEG_HEAD(i) = NULL;
+    }
+    TREE_ROOT = TREE_NIL;
+    COLOR(TREE_NIL) = BLACK;
+    for (i = 0; i < SLAB_CLASSES; i++)
+    {
+        SLAB_HEAD(i) = NULL;
+    }
+
+    if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
+    {
+        return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * slab_reset - Forget every run before the memlib heap is rebuilt
+ */
+static void slab_reset(void)
+{
+    size_t size = mem_max_heapsize() / RUN_SIZE + 1;
+
+    heap_startp = mem_heap_lo();
+    if (size != run_map_size)
+    {
+        free(run_map);
+        run_map = malloc(size);
+        run_map_size = size;
+    }
+    memset(run_map, 0, run_map_size);
+}
+
+static void *extend_heap(size_t words)
+{
+    char *bp;
+    size_t size;
+
+    size = (words % 2) ? ((words + 1) * WSIZE) : (words * WSIZE);
+
+    if ((long)(bp = HEAP_SBRK(size)) == -1)
+    {
+        return NULL;
+    }
+
+    /* The new block inherits the old epilogue's PREV_ALLOC bit */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, 0));
+
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+
+    return coalesce(bp);
+}
+
+/*
+ * get_class - Map a block size to its size class in O(1)
+ */
+static int get_class(size_t size)
+{
+    int cls = (63 - __builtin_clzll((unsigned long long)size)) - MIN_CLASS_SHIFT;
+
+    if (cls < 0)
+        return 0;
+    if (cls >= NUM_CLASSES)
+        return NUM_CLASSES - 1;
+    return cls;
+}
+
+/*
+ * insert_free_block - Push bp onto the front of its class's free list
+ */
+static void insert_free_block(void *bp)
+{
+    int cls;
+
+    if (GET_SIZE(HDRP(bp)) >= TREE_MIN_SIZE)
+    {
+        tree_insert(bp);
+        return;
+    }
+
+    cls = get_class(GET_SIZE(HDRP(bp)));
+    PRED_FREEP(bp) = NULL;
+    SUCC_FREEP(bp) = SEG_HEAD(cls);
+    if (SEG_HEAD(cls) != NULL)
+    {
+        PRED_FREEP(SEG_HEAD(cls)) = bp;
+    }
+    SEG_HEAD(cls) = bp;
+}
+
+/*
+ * remove_free_block - Unlink bp from its class's free list
+ */
+static void remove_free_block(void *bp)
+{
+    if (GET_SIZE(HDRP(bp)) >= TREE_MIN_SIZE)
+    {
+        tree_delete(bp);
+        return;
+    }
+
+    if (PRED_FREEP(bp) != NULL)
+    {
+        SUCC_FREEP(PRED_FREEP(bp)) = SUCC_FREEP(bp);
+    }
+    else
+    {
+        SEG_HEAD(get_class(GET_SIZE(HDRP(bp)))) = SUCC_FREEP(bp);
+    }
+    if (SUCC_FREEP(bp) != NULL)
+    {
+        PRED_FREEP(SUCC_FREEP(bp)) = PRED_FREEP(bp);
+    }
+}
+
+/*
+ * tree_less - Order tree nodes by size, breaking ties by address
+ */
+static int tree_less(char *a, char *b)
+{
+    size_t asize = GET_SIZE(HDRP(a));
+    size_t bsize = GET_SIZE(HDRP(b));
+
+    return (asize < bsize) || (asize == bsize && a < b);
+}
+
+static void rotate_left(char *x)
+{
+    char *y = RIGHT(x);
+
+    RIGHT(x) = LEFT(y);
+    if (LEFT(y) != TREE_NIL)
+        PARENT(LEFT(y)) = x;
+    PARENT(y) = PARENT(x);
+    if (PARENT(x) == TREE_NIL)
+        TREE_ROOT = y;
+    else if (x == LEFT(PARENT(x)))
+        LEFT(PARENT(x)) = y;
+    else
+        RIGHT(PARENT(x)) = y;
+    LEFT(y) = x;
+    PARENT(x) = y;
+}
+
+static void rotate_right(char *x)
+{
+    char *y = LEFT(x);
+
+    LEFT(x) = RIGHT(y);
+    if (RIGHT(y) != TREE_NIL)
+        PARENT(RIGHT(y)) = x;
+    PARENT(y) = PARENT(x);
+    if (PARENT(x) == TREE_NIL)
+        TREE_ROOT = y;
+    else if (x == RIGHT(PARENT(x)))
+        RIGHT(PARENT(x)) = y;
+    else
+        LEFT(PARENT(x)) = y;
+    RIGHT(y) = x;
+    PARENT(x) = y;
+}
+
+/*
+ * tree_insert - Add free block z to the tree and restore the
+ *     red-black invariants
+ */
+static void tree_insert(char *z)
+{
+    char *x = TREE_ROOT;
+    char *y = TREE_NIL;
+
+    while (x != TREE_NIL)
+    {
+        y = x;
+        x = tree_less(z, x) ? LEFT(x) : RIGHT(x);
+    }
+    PARENT(z) = y;
+    if (y == TREE_NIL)
+        TREE_ROOT = z;
+    else if (tree_less(z, y))
+        LEFT(y) = z;
+    else
+        RIGHT(y) = z;
+    LEFT(z) = TREE_NIL;
+    RIGHT(z) = TREE_NIL;
+    COLOR(z) = RED;
+
+    while (COLOR(PARENT(z)) == RED)
+    {
+        char *g = PARENT(PARENT(z));
+
+        if (PARENT(z) == LEFT(g))
+        {
+            y = RIGHT(g);
+            if (COLOR(y) == RED)
+            {
+                COLOR(PARENT(z)) = BLACK;
+                COLOR(y) = BLACK;
+                COLOR(g) = RED;
+                z = g;
+            }
+            else
+            {
+                if (z == RIGHT(PARENT(z)))
+                {
+                    z = PARENT(z);
+                    rotate_left(z);
+                }
+                COLOR(PARENT(z)) = BLACK;
+                COLOR(PARENT(PARENT(z))) = RED;
+                rotate_right(PARENT(PARENT(z)));
+            }
+        }
+        else
+        {
+            y = LEFT(g);
+            if (COLOR(y) == RED)
+            {
+                COLOR(PARENT(z)) = BLACK;
+                COLOR(y) = BLACK;
+                COLOR(g) = RED;
+                z = g;
+            }
+            else
+            {
+                if (z == LEFT(PARENT(z)))
+                {
+                    z = PARENT(z);
+                    rotate_right(z);
+                }
+                COLOR(PARENT(z)) = BLACK;
+                COLOR(PARENT(PARENT(z))) = RED;
+                rotate_left(PARENT(PARENT(z)));
+            }
+        }
+    }
+    COLOR(TREE_ROOT) = BLACK;
+}
+
+/*
+ * tree_transplant - Replace the subtree rooted at u with the one at v
+ */
+static void tree_transplant(char *u, char *v)
+{
+    if (PARENT(u) == TREE_NIL)
+        TREE_ROOT = v;
+    else if (u == LEFT(PARENT(u)))
+        LEFT(PARENT(u)) = v;
+    else
+        RIGHT(PARENT(u)) = v;
+    PARENT(v) = PARENT(u);
+}
+
+/*
+ * tree_delete - Unlink free block z from the tree and restore the
+ *     red-black invariants
+ */
+static void tree_delete(char *z)
+{
+    char *x, *w;
+    char *y = z;
+    unsigned int y_color = COLOR(y);
+
+    if (LEFT(z) == TREE_NIL)
+    {
+        x = RIGHT(z);
+        tree_transplant(z, RIGHT(z));
+    }
+    else if (RIGHT(z) == TREE_NIL)
+    {
+        x = LEFT(z);
+        tree_transplant(z, LEFT(z));
+    }
+    else
+    {
+        y = RIGHT(z);
+        while (LEFT(y) != TREE_NIL)
+            y = LEFT(y);
+        y_color = COLOR(y);
+        x = RIGHT(y);
+        if (PARENT(y) == z)
+        {
+            PARENT(x) = y;
+        }
+        else
+        {
+            tree_transplant(y, RIGHT(y));
+            RIGHT(y) = RIGHT(z);
+            PARENT(RIGHT(y)) = y;
+        }
+        tree_transplant(z, y);
+        LEFT(y) = LEFT(z);
+        PARENT(LEFT(y)) = y;
+        COLOR(y) = COLOR(z);
+    }
+
+    if (y_color == RED)
+        return;
+
+    while (x != TREE_ROOT && COLOR(x) == BLACK)
+    {
+        if (x == LEFT(PARENT(x)))
+        {
+            w = RIGHT(PARENT(x));
+            if (COLOR(w) == RED)
+            {
+                COLOR(w) = BLACK;
+                COLOR(PARENT(x)) = RED;
+                rotate_left(PARENT(x));
+                w = RIGHT(PARENT(x));
+            }
+            if (COLOR(LEFT(w)) == BLACK && COLOR(RIGHT(w)) == BLACK)
+            {
+                COLOR(w) = RED;
+                x = PARENT(x);
+            }
+            else
+            {
+                if (COLOR(RIGHT(w)) == BLACK)
+                {
+                    COLOR(LEFT(w)) = BLACK;
+                    COLOR(w) = RED;
+                    rotate_right(w);
+                    w = RIGHT(PARENT(x));
+                }
+                COLOR(w) = COLOR(PARENT(x));
+                COLOR(PARENT(x)) = BLACK;
+                COLOR(RIGHT(w)) = BLACK;
+                rotate_left(PARENT(x));
+                x = TREE_ROOT;
+            }
+        }
+        else
+        {
+            w = LEFT(PARENT(x));
+            if (COLOR(w) == RED)
+            {
+                COLOR(w) = BLACK;
+                COLOR(PARENT(x)) = RED;
+                rotate_right(PARENT(x));
+                w = LEFT(PARENT(x));
+            }
+            if (COLOR(RIGHT(w)) == BLACK && COLOR(LEFT(w)) == BLACK)
+            {
+                COLOR(w) = RED;
+                x = PARENT(x);
+            }
+            else
+            {
+                if (COLOR(LEFT(w)) == BLACK)
+                {
+                    COLOR(RIGHT(w)) = BLACK;
+                    COLOR(w) = RED;
+                    rotate_left(w);
+                    w = LEFT(PARENT(x));
+                }
+                COLOR(w) = COLOR(PARENT(x));
+                COLOR(PARENT(x)) = BLACK;
+                COLOR(LEFT(w)) = BLACK;
+                rotate_right(PARENT(x));
+                x = TREE_ROOT;
+            }
+        }
+    }
+    COLOR(x) = BLACK;
+}
+
+/*
+ * tree_find_fit - Return the smallest tree block of at least asize
+ *     bytes (lowest address among equal sizes), or NULL
+ */
+static void *tree_find_fit(size_t asize)
+{
+    char *x = TREE_ROOT;
+    char *best = NULL;
+
+    while (x != TREE_NIL)
+    {
+        if (GET_SIZE(HDRP(x)) >= asize)
+        {
+            best = x;
+            x = LEFT(x);
+        }
+        else
+        {
+            x = RIGHT(x);
+        }
+    }
+    return best;
+}
+
+/*
+ * coalesce - Merge bp with its free neighbours and put the result on
+ *     the free list.  bp itself must not be on the list yet, and the
+ *     following block's PREV_ALLOC bit must already be clear.  The
+ *     block before a merged block is always allocated.
+ */
+static void *coalesce(void *bp)
+{
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp));
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (prev_alloc && !next_alloc)
+    {
+        remove_free_block(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(size, 0));
+    }
+    else if (!prev_alloc && next_alloc)
+    {
+        remove_free_block(PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        PUT(FTRP(bp), PACK(size, 0));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        bp = PREV_BLKP(bp);
+    }
+    else if (!prev_alloc && !next_alloc)
+    {
+        remove_free_block(PREV_BLKP(bp));
+        remove_free_block(NEXT_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) + GET_SIZE(FTRP(NEXT_BLKP(bp)));
+        PUT(HDRP(PREV_BLKP(bp)), PACK(size, PREV_ALLOC));
+        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
+        bp = PREV_BLKP(bp);
+    }
+
+    insert_free_block(bp);
+    return bp;
+}
+
+static void *heap_malloc(size_t size)
+{
+    size_t asize;
+    size_t extendsize;
+    char *bp;
+
+    if (size == 0)
+        return NULL;
+
+    if (size <= SLAB_MAX)
+        return slab_alloc(size);
+    if (size >= MM_MAP_THRESHOLD && (bp = map_alloc(size)) != NULL)
+        return bp;
+    if (size > MAX_REQUEST)
+        return NULL;
+
+    asize = MAX(MINBLOCKSIZE, ALIGN(size + WSIZE));
+
+    if ((bp = find_fit(asize)) != NULL)
+    {
+        place(bp, asize);
+        return bp;
+    }
+
+    extendsize = MAX(asize, CHUNKSIZE);
+    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+        return NULL;
+    place(bp, asize);
+    return bp;
+}
+
+static void heap_free(void *bp)
+{
+    if (mem_is_mapped(bp))
+    {
+        map_free(bp);
+        return;
+    }
+    if (IS_RUN(bp))
+    {
+        slab_free(bp);
+        return;
+    }
+
+    size_t size = GET_SIZE(HDRP(bp));
+
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp))));
+    PUT(FTRP(bp), PACK(size, 0));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+
+    trim_heap(coalesce(bp));
+}
+
+/*
+ * trim_heap - Give all but TRIM_KEEP bytes of bp back to memlib if bp is
+ *     a free block of at least TRIM_THRESHOLD bytes at the top of the heap.
+ *     bp must be coalesced, so the block before it is allocated.
+ */
+static void trim_heap(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (size < TRIM_THRESHOLD || GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0)
+        return;
+
+    remove_free_block(bp);
+    PUT(HDRP(bp), PACK(TRIM_KEEP, PREV_ALLOC));
+    PUT(FTRP(bp), PACK(TRIM_KEEP, 0));
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));
+    insert_free_block(bp);
+
+    HEAP_SBRK(-(intptr_t)(size - TRIM_KEEP));
+}
+
+/*
+ * map_alloc - Give a request its own mem_map mapping
+ */
+static void *map_alloc(size_t size)
+{
+    char *p;
+
+    if ((p = mem_map(MAP_LEN(size))) == (void *)-1)
+        return NULL;
+    PUT(p + WSIZE, PACK(MAP_LEN(size), 1));
+    return p + DSIZE;
+}
+
+static void map_free(void *bp)
+{
+    mem_unmap((char *)bp - DSIZE);
+}
+
+/*
+ * map_realloc - Resize a mapped block by remapping it; size must not be 0
+ */
+static void *map_realloc(void *bp, size_t size)
+{
+    char *p;
+
+    if ((p = mem_remap((char *)bp - DSIZE, MAP_LEN(size))) == (void *)-1)
+        return NULL;
+    PUT(p + WSIZE, PACK(MAP_LEN(size), 1));
+    return p + DSIZE;
+}
+
+static void *heap_realloc(void *bp, size_t size)
+{
+    if (size == 0)
+    {
+        heap_free(bp);
+        return NULL;
+    }
+    if (bp == NULL)
+    {
+        return heap_malloc(size);
+    }
+    if (mem_is_mapped(bp))
+    {
+        char *new_bp;
+
+        if ((new_bp = map_realloc(bp, size)) != NULL)
+            return new_bp;
+        /* The mem_map range is full: move the block into the heap */
+        if ((new_bp = heap_malloc(size)) == NULL)
+            return NULL;
+        memcpy(new_bp, bp, MAP_PAYLOAD(bp));
+        map_free(bp);
+        return new_bp;
+    }
+
+    if (IS_RUN(bp))
+    {
+        run_t *run = RUNP(bp);
+        char *new_slot;
+
+        if (size <= run->slot_size)
+            return bp;
+        if ((new_slot = heap_malloc(size)) == NULL)
+            return NULL;
+        memcpy(new_slot, bp, run->slot_size);
+        slab_free(bp);
+        return new_slot;
+    }
+    if (size > MAX_REQUEST)
+        return NULL;
+
+    size_t oldsize = GET_SIZE(HDRP(bp));
+    size_t asize = MAX(MINBLOCKSIZE, ALIGN(size + WSIZE));
+    size_t rsize = asize;
+    size_t avail = oldsize;
+    char *next = NEXT_BLKP(bp);
+    char *tail = next;
+
+    if (GET_REALLOC_TAG(HDRP(bp)))
+    {
+        /* Growing into the reserve */
+        if (asize <= oldsize && oldsize <= RESERVE(asize))
+            return bp;
+        rsize = RESERVE(asize);
+    }
+
+    /* Shrinking: keep the block, free the tail (and any reserve) */
+    if (asize <= oldsize)
+    {
+        split_tail(bp, asize);
+        return bp;
+    }
+
+    if (!GET_ALLOC(HDRP(next)))
+    {
+        avail += GET_SIZE(HDRP(next));
+        tail = NEXT_BLKP(next);
+    }
+
+    /* At the top of the heap: sbrk just the shortfall, which extend_heap
+       merges into a free block right after bp */
+    if (avail < rsize && GET_SIZE(HDRP(tail)) == 0)
+    {
+        if (extend_heap(MAX(rsize - avail, MINBLOCKSIZE) / WSIZE) == NULL)
+            return NULL;
+        avail = oldsize + GET_SIZE(HDRP(next));
+    }
+
+    /* Growing into the free successor, reserve included if it fits */
+    if (avail >= asize)
+    {
+        remove_free_block(next);
+        PUT(HDRP(bp), PACK(avail, GET_PREV_ALLOC(HDRP(bp)) | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+        split_tail(bp, (avail < rsize) ? avail : rsize);
+        SET_REALLOC_TAG(HDRP(bp));
+        return bp;
+    }
+
+    void *new_bp = heap_malloc(rsize - WSIZE);
+    if (new_bp == NULL)
+        return NULL;
+    /* A slab slot has no header of its own to tag */
+    if (rsize - WSIZE > SLAB_MAX)
+        SET_REALLOC_TAG(HDRP(new_bp));
+
+    size_t copySize = oldsize - WSIZE;
+    if (size < copySize)
+        copySize = size;
+    memcpy(new_bp, bp, copySize);
+
+    heap_free(bp);
+    return new_bp;
+}
+
+#if MM_THREADS
+
+#if MM_ARENAS > 1
+
+/*
+ * my_arena - The arena the calling thread allocates from: its CPU's, or
+ *     one handed out round-robin on the thread's first call
+ */
+static int my_arena(void)
+{
+#if MM_ARENA_BY_CPU
+    int cpu = sched_getcpu();
+
+    return (cpu < 0) ? 0 : cpu % MM_ARENAS;
+#else
+    if (thread_arena < 0)
+        thread_arena = __atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % MM_ARENAS;
+    return thread_arena;
+#endif
+}
+
+/*
+ * remote_free - Push bp onto its owning arena's remote-free queue.
+ *     Any number of threads may push; only the owner pops, and it
+ *     always takes the whole queue, so a plain CAS push is ABA-safe.
+ */
+static void remote_free(void *bp)
+{
+    arena_t *arena = &arenas[mem_arena_id(bp)];
+    void *head = __atomic_load_n(&arena->remote, __ATOMIC_RELAXED);
+
+    do
+    {
+        *(void **)bp = head;
+    } while (!__atomic_compare_exchange_n(&arena->remote, &head, bp, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+/*
+ * heap_enter - Lock arena id and make it the heap the heap_* routines
+ *     work on, laying it down on first use.  Blocks other threads have
+ *     queued for the arena are freed here.  Returns -1 if the arena
+ *     could not be set up.
+ */
+static int heap_enter(int id)
+{
+    arena_t *arena = &arenas[id];
+    void *bp, *next;
+
+    pthread_mutex_lock(&arena->lock);
+    cur_arena = id;
+    heap_listp = arena->listp;
+    if (heap_listp == NULL)
+    {
+        if (heap_init() < 0)
+        {
+            pthread_mutex_unlock(&arena->lock);
+            return -1;
+        }
+        arena->listp = heap_listp;
+    }
+
+    bp = __atomic_exchange_n(&arena->remote, NULL, __ATOMIC_ACQUIRE);
+    while (bp != NULL)
+    {
+        next = *(void **)bp;
+        heap_free(bp);
+        bp = next;
+    }
+    return 0;
+}
+
+static void heap_leave(void)
+{
+    pthread_mutex_unlock(&arenas[cur_arena].lock);
+}
+
+#else
+
+static int my_arena(void)
+{
+    return 0;
+}
+
+static int heap_enter(int id)
+{
+    pthread_mutex_lock(&heap_lock);
+    return 0;
+}
+
+static void heap_leave(void)
+{
+    pthread_mutex_unlock(&heap_lock);
+}
+
+#endif /* MM_ARENAS > 1 */
+
+/*
+ * tcache_reset - Start this thread's cache over if mm_init has built a
+ *     new heap since it was last used, and make sure the cache is
+ *     flushed when the thread exits
+ */
+static void tcache_reset(void)
+{
+    if (tcache.gen == heap_gen)
+        return;
+    memset(&tcache, 0, sizeof(tcache));
+    tcache.gen = heap_gen;
+    pthread_once(&tcache_once, tcache_key_create);
+    pthread_setspecific(tcache_key, &tcache);
+}
+
+/*
+ * tcache_flush - Give up to n cached slots of class cls back to their
+ *     runs, taking the heap lock once.  Slots owned by another arena
+ *     go onto that arena's remote-free queue instead.
+ */
+static void tcache_flush(int cls, unsigned int n)
+{
+    int id = my_arena();
+    void *bp;
+
+    if (heap_enter(id) < 0)
+        return;
+    while (n-- > 0 && (bp = tcache.head[cls]) != NULL)
+    {
+        tcache.head[cls] = *(void **)bp;
+        tcache.count[cls]--;
+#if MM_ARENAS > 1
+        if (mem_arena_id(bp) != id)
+        {
+            remote_free(bp);
+            continue;
+        }
+#endif
+        slab_free(bp);
+    }
+    heap_leave();
+}
+
+/*
+ * tcache_release - Thread-exit destructor: flush every class
+ */
+static void tcache_release(void *arg)
+{
+    int cls;
+
+    if (tcache.gen != heap_gen)
+        return;
+    for (cls = 0; cls < SLAB_CLASSES; cls++)
+        tcache_flush(cls, TCACHE_MAX);
+}
+
+static void tcache_key_create(void)
+{
+    pthread_key_create(&tcache_key, tcache_release);
+}
+
+/*
+ * mm_init - Must not run concurrently with any other mm_ call
+ */
+int mm_init(void)
+{
+    int ret;
+
+    heap_gen++;
+    slab_reset();
+#if MM_ARENAS > 1
+    {
+        int i;
+
+        mem_set_arenas(MM_ARENAS);
+        for (i = 0; i < MM_ARENAS; i++)
+        {
+            arenas[i].listp = NULL;
+            arenas[i].remote = NULL;
+        }
+    }
+    if ((ret = heap_enter(my_arena())) == 0)
+        heap_leave();
+#else
+    pthread_mutex_lock(&heap_lock);
+    ret = heap_init();
+    pthread_mutex_unlock(&heap_lock);
+#endif
+    return ret;
+}
+
+/*
+ * tcache_fill - Take one slot for the caller and a batch for the cache.
+ *     Called inside heap_enter.
+ */
+static void *tcache_fill(size_t size)
+{
+    int cls = SLAB_CLASS(size);
+    void *bp, *extra;
+    int i;
+
+    bp = slab_alloc(size);
+    for (i = 1; i < TCACHE_BATCH && bp != NULL; i++)
+    {
+        if ((extra = slab_alloc(size)) == NULL)
+            break;
+        *(void **)extra = tcache.head[cls];
+        tcache.head[cls] = extra;
+        tcache.count[cls]++;
+    }
+    return bp;
+}
+
+/*
+ * mm_malloc - Allocates from the calling thread's arena, spilling over
+ *     into the other arenas in turn once that one is full
+ */
+void *mm_malloc(size_t size)
+{
+    void *bp = NULL;
+    int cls, id, i;
+
+    if (size == 0)
+        return NULL;
+    if (size >= MM_MAP_THRESHOLD && (bp = map_alloc(size)) != NULL)
+        return bp;
+
+    if (size <= SLAB_MAX)
+    {
+        cls = SLAB_CLASS(size);
+        tcache_reset();
+        if ((bp = tcache.head[cls]) != NULL)
+        {
+            tcache.head[cls] = *(void **)bp;
+            tcache.count[cls]--;
+            return bp;
+        }
+    }
+
+    id = my_arena();
+    for (i = 0; i < MM_ARENAS && bp == NULL; i++)
+    {
+        if (heap_enter((id + i) % MM_ARENAS) < 0)
+            continue;
+        bp = (size > SLAB_MAX) ? heap_malloc(size) : tcache_fill(size);
+        heap_leave();
+    }
+    return bp;
+}
+
+void mm_free(void *bp)
+{
+    int cls;
+
+    if (mem_is_mapped(bp))
+    {
+        map_free(bp);
+        return;
+    }
+    if (!IS_RUN(bp))
+    {
+#if MM_ARENAS > 1
+        if (mem_arena_id(bp) != my_arena())
+        {
+            remote_free(bp);
+            return;
+        }
+#endif
+        heap_enter(my_arena());
+        heap_free(bp);
+        heap_leave();
+        return;
+    }
+
+    /* slot_size is fixed for the life of the run, so no lock needed */
+    cls = SLAB_CLASS(RUNP(bp)->slot_size);
+    tcache_reset();
+    if (tcache.count[cls] >= TCACHE_MAX)
+        tcache_flush(cls, TCACHE_BATCH);
+    *(void **)bp = tcache.head[cls];
+    tcache.head[cls] = bp;
+    tcache.count[cls]++;
+}
+
+/*
+ * mm_realloc - Resizes in the arena that owns bp, whichever thread
+ *     calls it
+ */
+void *mm_realloc(void *bp, size_t size)
+{
+    void *new_bp;
+    int id = my_arena();
+
+    if (bp != NULL && mem_is_mapped(bp))
+    {
+        if (size == 0)
+        {
+            map_free(bp);
+            return NULL;
+        }
+        if ((new_bp = map_realloc(bp, size)) != NULL)
+            return new_bp;
+        /* The mem_map range is full: move the block into an arena */
+        if ((new_bp = mm_malloc(size)) == NULL)
+            return NULL;
+        memcpy(new_bp, bp, MAP_PAYLOAD(bp));
+        map_free(bp);
+        return new_bp;
+    }
+#if MM_ARENAS > 1
+    if (bp != NULL)
+        id = mem_arena_id(bp);
+#endif
+    if (heap_enter(id) < 0)
+        return NULL;
+    new_bp = heap_realloc(bp, size);
+    heap_leave();
+    return new_bp;
+}
+
+#else
+
+int mm_init(void)
+{
+    slab_reset();
+    return heap_init();
+}
+
+void *mm_malloc(size_t size)
+{
+    return heap_malloc(size);
+}
+
+void mm_free(void *bp)
+{
+    heap_free(bp);
+}
+
+void *mm_realloc(void *bp, size_t size)
+{
+    return heap_realloc(bp, size);
+}
+
+#endif /* MM_THREADS */
+
+/*
+ * find_fit - First fit within the request's class, then the next
+ *     larger non-empty classes, then best fit in the tree
+ */
+static void *find_fit(size_t asize)
+{
+    char *bp;
+    int cls;
+
+    if (asize < TREE_MIN_SIZE)
+    {
+        for (cls = get_class(asize); cls < NUM_CLASSES; cls++)
+        {
+            for (bp = SEG_HEAD(cls); bp != NULL; bp = SUCC_FREEP(bp))
+            {
+                if (asize <= GET_SIZE(HDRP(bp)))
+                {
+                    return bp;
+                }
+            }
+        }
+    }
+    return tree_find_fit(asize);
+}
+
+static void place(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+
+    remove_free_block(bp);
+
+    if ((csize - asize) >= MINBLOCKSIZE)
+    {
+        PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+        bp = NEXT_BLKP(bp);
+        PUT(HDRP(bp), PACK(csize - asize, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(csize - asize, 0));
+        insert_free_block(bp);
+    }
+    else
+    {
+        PUT(HDRP(bp), PACK(csize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));
+    }
+}
+
+/*
+ * split_tail - Shrink allocated block bp to asize bytes and free the
+ *     rest, if the rest is big enough to be a block of its own.  Like
+ *     heap_free, trims the heap if the rest joins the wilderness.
+ */
+static void split_tail(void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    char *rest;
+
+    if ((csize - asize) < MINBLOCKSIZE)
+        return;
+
+    PUT(HDRP(bp), PACK(asize, GET_PREV_ALLOC(HDRP(bp)) | 1));
+    rest = NEXT_BLKP(bp);
+    PUT(HDRP(rest), PACK(csize - asize, PREV_ALLOC));
+    PUT(FTRP(rest), PACK(csize - asize, 0));
+    CLR_PREV_ALLOC(HDRP(NEXT_BLKP(rest)));
+    trim_heap(coalesce(rest));
+}
+
+/*
+ * alloc_aligned - Allocate an asize-byte block whose payload address is
+ *     a multiple of align.  The gap in front of it, if any, is split off
+ *     as a free block, so it is either empty or at least MINBLOCKSIZE.
+ */
+static void *alloc_aligned(size_t asize, size_t align)
+{
+    char *bp, *ap;
+    size_t csize, lead;
+
+    if ((bp = find_fit(asize + align + MINBLOCKSIZE)) == NULL)
+    {
+        /* Extend by exactly the gap plus the block at the heap top */
+        bp = (char *)HEAP_HI() + 1;
+        ap = (char *)(((unsigned long)bp + align - 1) & ~(unsigned long)(align - 1));
+        if (ap != bp && (size_t)(ap - bp) < MINBLOCKSIZE)
+            ap += align;
+        if ((bp = extend_heap((ap - bp + asize) / WSIZE)) == NULL)
+            return NULL;
+    }
+
+    csize = GET_SIZE(HDRP(bp));
+    ap = (char *)(((unsigned long)bp + align - 1) & ~(unsigned long)(align - 1));
+    if (ap != bp && (size_t)(ap - bp) < MINBLOCKSIZE)
+        ap += align;
+    lead = ap - bp;
+
+    if (lead > 0)
+    {
+        remove_free_block(bp);
+        PUT(HDRP(bp), PACK(lead, GET_PREV_ALLOC(HDRP(bp))));
+        PUT(FTRP(bp), PACK(lead, 0));
+        insert_free_block(bp);
+        PUT(HDRP(ap), PACK(csize - lead, 0));
+        PUT(FTRP(ap), PACK(csize - lead, 0));
+        insert_free_block(ap);
+    }
+    place(ap, asize);
+    return ap;
+}
+
+/*
+ * push_run - Put run at the front of its class's list of runs with a
+ *     free slot
+ */
+static void push_run(run_t *run)
+{
+    int cls = SLAB_CLASS(run->slot_size);
+
+    run->prev = NULL;
+    run->next = SLAB_HEAD(cls);
+    if (run->next != NULL)
+        run->next->prev = run;
+    SLAB_HEAD(cls) = run;
+}
+
+/*
+ * unlink_run - Take run off its class's list
+ */
+static void unlink_run(run_t *run)
+{
+    if (run->prev != NULL)
+        run->prev->next = run->next;
+    else
+        SLAB_HEAD(SLAB_CLASS(run->slot_size)) = run->next;
+    if (run->next != NULL)
+        run->next->prev = run->prev;
+}
+
+/*
+ * new_run - Carve a page-aligned run for slab class cls out of the heap
+ */
+static run_t *new_run(int cls)
+{
+    run_t *run;
+    unsigned int i;
+
+    if ((run = alloc_aligned(RUN_BLOCKSIZE, RUN_SIZE)) == NULL)
+        return NULL;
+
+    run->slot_size = (cls + 1) * ALIGNMENT;
+    run->nslots = (RUN_SIZE - RUN_HDRSIZE) / run->slot_size;
+    run->nfree = run->nslots;
+    memset(run->bitmap, 0, sizeof(run->bitmap));
+    for (i = 0; i < run->nslots / 32; i++)
+        run->bitmap[i] = ~0u;
+    if (run->nslots % 32)
+        run->bitmap[i] = (1u << (run->nslots % 32)) - 1;
+
+    run_map[RUN_PAGE(run)] = 1;
+    push_run(run);
+    return run;
+}
+
+/*
+ * slab_alloc - Hand out the lowest free slot of the first run in the
+ *     request's class
+ */
+static void *slab_alloc(size_t size)
+{
+    int cls = SLAB_CLASS(size);
+    run_t *run = SLAB_HEAD(cls);
+    int i, bit;
+
+    if (run == NULL && (run = new_run(cls)) == NULL)
+        return NULL;
+
+    for (i = 0; run->bitmap[i] == 0; i++)
+        ;
+    bit = __builtin_ctz(run->bitmap[i]);
+    run->bitmap[i] &= ~(1u << bit);
+    if (--run->nfree == 0)
+        unlink_run(run);
+
+    return (char *)run + RUN_HDRSIZE + (i * 32 + bit) * run->slot_size;
+}
+
+/*
+ * slab_free - Return a slot to its run, and an empty run to the heap
+ */
+static void slab_free(void *bp)
+{
+    run_t *run = RUNP(bp);
+    unsigned int slot = ((char *)bp - ((char *)run + RUN_HDRSIZE)) / run->slot_size;
+
+    run->bitmap[slot / 32] |= 1u << (slot % 32);
+    if (run->nfree++ == 0)
+        push_run(run);
+
+    /* Keep the last run of a class around to avoid thrashing */
+    if (run->nfree == run->nslots &&
+        (run->prev != NULL || run->next != NULL))
+    {
+        unlink_run(run);
+        run_map[RUN_PAGE(run)] = 0;
+        heap_free(run);
+    }
+}
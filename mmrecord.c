@@ -0,0 +1,669 @@
+/*
+ * mmrecord.c - Record the malloc calls of a real program as a trace
+ *
+ * usage: LD_PRELOAD=./mmrecord.so [MMRECORD=out.rep] program args...
+ *
+ * malloc, calloc, realloc, reallocarray, free and the memalign family
+ * are interposed and passed on to glibc through its __libc_* entry
+ * points, so there is no dlsym bootstrapping.  Each call is logged as
+ * an event stamped from one global sequence counter, which orders the
+ * calls of all threads: an allocation takes its stamp after glibc
+ * returns the block, a free before glibc gets it back, so a block's
+ * allocation always precedes its free.  A realloc does both, and is
+ * logged as two events: one stamped before the call gives up the old
+ * address, and one stamped after it binds the block to the new one.
+ *
+ * Events go into a chunk owned by the calling thread, without locks.
+ * A full chunk is pushed onto a lock-free list, which a writer thread
+ * empties every few milliseconds into an unlinked spill file.  At exit
+ * the finalizer collects what is left, sorts the spill by stamp, gives
+ * every block an id in the a/r/f format of read_trace, frees whatever
+ * is still live as checktrace.pl does, and writes the balanced trace
+ * to $MMRECORD, or mmrecord-<pid>.rep.  A %p in $MMRECORD becomes the
+ * pid, which keeps apart the traces of programs that exec others.
+ *
+ * Alignment is not part of the trace format, so the memalign family is
+ * recorded as plain allocations, and zero-byte requests as one byte,
+ * since mm_malloc(0) need not return a block.  Frees of blocks we never
+ * saw allocated (made before we were loaded) are dropped.  A forked
+ * child stops recording; a program it execs is recorded on its own.
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+
+/* glibc's own allocator */
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void *__libc_valloc(size_t size);
+
+/* Event types besides ALLOC, FREE and REALLOC, the halves of a realloc */
+#define UNMAP 3	  /* realloc is about to give up the old address */
+#define RESTORE 4 /* ... but failed, so the block stays there */
+
+#define CHUNK_EVENTS 4096	 /* events in one thread's chunk */
+#define WRITER_PERIOD 10	 /* ms between the writer's passes */
+#define LOCAL __attribute__((tls_model("initial-exec"))) static __thread
+
+/* One call, as logged by the thread that made it */
+typedef struct
+{
+	uint64_t seq;  /* global order of the call */
+	uint64_t size; /* bytes asked for (ALLOC, REALLOC) */
+	uintptr_t ptr; /* block returned, freed, or given up (UNMAP) */
+	uint64_t link; /* seq + 1 of the UNMAP (REALLOC, RESTORE) */
+	uint32_t type; /* ALLOC, FREE, REALLOC, UNMAP or RESTORE */
+} recevent_t;
+
+typedef struct chunk
+{
+	struct chunk *next; /* on the full list */
+	int count;			/* events filled in */
+	recevent_t events[CHUNK_EVENTS];
+} chunk_t;
+
+/* What each thread records into; all of them are on the threads list */
+typedef struct thread_rec
+{
+	struct thread_rec *next;
+	chunk_t *chunk; /* filling, or NULL */
+	int logging;	/* between rec_event and rec_done */
+} thread_rec_t;
+
+static uint64_t seq = 0;			  /* next stamp */
+static int recording = 1;			  /* cleared by the finalizer and in children */
+static chunk_t *full = NULL;		  /* lock-free list of full chunks */
+static thread_rec_t *threads = NULL;  /* lock-free list of recording threads */
+static int spill = -1;				  /* fd of the spill file */
+static pthread_t writer;
+static int writer_running = 0;
+static int writer_stop = 0;
+static char out_path[4096];
+
+LOCAL thread_rec_t *self = NULL;
+LOCAL int busy = 0; /* inside the recorder: calls pass straight through */
+
+static void rec_flush(chunk_t *list);
+
+/**********************************
+ * Logging calls from the program
+ **********************************/
+
+/*
+ * rec_event - Start logging one call: returns the event for the caller
+ *     to fill in and hand to rec_done, or NULL if the call is not to be
+ *     logged.  The finalizer takes a thread's chunk only once the
+ *     thread is out of here, and the thread looks at recording only
+ *     after saying it is in, so one of them always sees the other.
+ */
+static recevent_t *rec_event(uint32_t type)
+{
+	thread_rec_t *t = self;
+	chunk_t *c;
+	recevent_t *e;
+
+	if (t == NULL)
+	{
+		if ((t = __libc_calloc(1, sizeof(thread_rec_t))) == NULL)
+			return NULL;
+		t->next = __atomic_load_n(&threads, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&threads, &t->next, t, 1,
+											__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+			;
+		self = t;
+	}
+	__atomic_store_n(&t->logging, 1, __ATOMIC_SEQ_CST);
+	if (!__atomic_load_n(&recording, __ATOMIC_SEQ_CST))
+	{
+		__atomic_store_n(&t->logging, 0, __ATOMIC_RELEASE);
+		return NULL;
+	}
+
+	c = t->chunk;
+	if (c == NULL || c->count == CHUNK_EVENTS)
+	{
+		/* Hand the full chunk to the writer */
+		if (c != NULL)
+		{
+			c->next = __atomic_load_n(&full, __ATOMIC_RELAXED);
+			while (!__atomic_compare_exchange_n(&full, &c->next, c, 1,
+												__ATOMIC_RELEASE, __ATOMIC_RELAXED))
+				;
+		}
+		if ((c = __libc_malloc(sizeof(chunk_t))) != NULL)
+			c->count = 0;
+		t->chunk = c;
+		if (c == NULL)
+		{
+			__atomic_store_n(&t->logging, 0, __ATOMIC_RELEASE);
+			return NULL;
+		}
+	}
+
+	e = &c->events[c->count];
+	e->type = type;
+	return e;
+}
+
+/* rec_done - Finish logging the event rec_event returned */
+static void rec_done(void)
+{
+	self->chunk->count++;
+	__atomic_store_n(&self->logging, 0, __ATOMIC_RELEASE);
+}
+
+static int rec_active(void)
+{
+	return !busy && __atomic_load_n(&recording, __ATOMIC_RELAXED);
+}
+
+static uint64_t rec_stamp(void)
+{
+	return __atomic_fetch_add(&seq, 1, __ATOMIC_SEQ_CST);
+}
+
+static void *rec_alloc(void *p, size_t size)
+{
+	recevent_t *e;
+
+	if (p != NULL && rec_active() && (e = rec_event(ALLOC)) != NULL)
+	{
+		e->seq = rec_stamp();
+		e->ptr = (uintptr_t)p;
+		e->size = (size == 0) ? 1 : size;
+		rec_done();
+	}
+	return p;
+}
+
+void *malloc(size_t size)
+{
+	return rec_alloc(__libc_malloc(size), size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+	return rec_alloc(__libc_calloc(n, size), n * size);
+}
+
+void *memalign(size_t alignment, size_t size)
+{
+	return rec_alloc(__libc_memalign(alignment, size), size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size)
+{
+	return rec_alloc(__libc_memalign(alignment, size), size);
+}
+
+void *valloc(size_t size)
+{
+	return rec_alloc(__libc_valloc(size), size);
+}
+
+int posix_memalign(void **memptr, size_t alignment, size_t size)
+{
+	void *p;
+
+	if (alignment % sizeof(void *) != 0 || (alignment & (alignment - 1)) != 0)
+		return EINVAL;
+	if ((p = __libc_memalign(alignment, size)) == NULL)
+		return ENOMEM;
+	*memptr = rec_alloc(p, size);
+	return 0;
+}
+
+void free(void *ptr)
+{
+	recevent_t *e;
+
+	if (ptr != NULL && rec_active() && (e = rec_event(FREE)) != NULL)
+	{
+		e->seq = rec_stamp();
+		e->ptr = (uintptr_t)ptr;
+		rec_done();
+	}
+	__libc_free(ptr);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+	recevent_t *e;
+	uint64_t link = 0;
+	void *p;
+
+	if (ptr == NULL)
+		return malloc(size);
+	if (size == 0)
+	{
+		/* What glibc's realloc does */
+		free(ptr);
+		return NULL;
+	}
+
+	if (rec_active() && (e = rec_event(UNMAP)) != NULL)
+	{
+		e->seq = rec_stamp();
+		e->ptr = (uintptr_t)ptr;
+		link = e->seq + 1;
+		rec_done();
+	}
+	p = __libc_realloc(ptr, size);
+	if (link != 0 && (e = rec_event((p != NULL) ? REALLOC : RESTORE)) != NULL)
+	{
+		e->seq = rec_stamp();
+		e->ptr = (p != NULL) ? (uintptr_t)p : (uintptr_t)ptr;
+		e->link = link;
+		e->size = size;
+		rec_done();
+	}
+	return p;
+}
+
+void *reallocarray(void *ptr, size_t n, size_t size)
+{
+	if (size != 0 && n > SIZE_MAX / size)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	return realloc(ptr, n * size);
+}
+
+/****************************
+ * The writer thread
+ ****************************/
+
+/*
+ * rec_flush - Append the events of a list of chunks to the spill file
+ *     and free the chunks
+ */
+static void rec_flush(chunk_t *list)
+{
+	chunk_t *c;
+	size_t len;
+	char *p;
+	ssize_t n;
+
+	while ((c = list) != NULL)
+	{
+		list = c->next;
+		p = (char *)c->events;
+		len = c->count * sizeof(recevent_t);
+		while (len > 0 && (n = write(spill, p, len)) > 0)
+		{
+			p += n;
+			len -= n;
+		}
+		__libc_free(c);
+	}
+}
+
+static void *writer_main(void *arg)
+{
+	struct timespec period = {0, WRITER_PERIOD * 1000000L};
+
+	busy = 1; /* nothing this thread does is recorded */
+	while (!__atomic_load_n(&writer_stop, __ATOMIC_ACQUIRE))
+	{
+		rec_flush(__atomic_exchange_n(&full, NULL, __ATOMIC_ACQUIRE));
+		nanosleep(&period, NULL);
+	}
+	return NULL;
+}
+
+/* A forked child has no writer; leave the recording to the parent */
+static void rec_child(void)
+{
+	__atomic_store_n(&recording, 0, __ATOMIC_RELAXED);
+	writer_running = 0;
+	spill = -1;
+}
+
+__attribute__((constructor)) static void rec_start(void)
+{
+	char *env, *pid;
+	char tmpl[4096 + 16];
+
+	busy = 1;
+	if ((env = getenv("MMRECORD")) == NULL || *env == '\0')
+		snprintf(out_path, sizeof(out_path), "mmrecord-%d.rep", (int)getpid());
+	else if ((pid = strstr(env, "%p")) != NULL)
+		snprintf(out_path, sizeof(out_path), "%.*s%d%s",
+				 (int)(pid - env), env, (int)getpid(), pid + 2);
+	else
+		snprintf(out_path, sizeof(out_path), "%s", env);
+
+	/* The spill file lives next to the trace and vanishes with us */
+	snprintf(tmpl, sizeof(tmpl), "%s.XXXXXX", out_path);
+	if ((spill = mkstemp(tmpl)) < 0)
+	{
+		fprintf(stderr, "mmrecord: cannot create %s: %s\n", tmpl, strerror(errno));
+		__atomic_store_n(&recording, 0, __ATOMIC_RELAXED);
+		busy = 0;
+		return;
+	}
+	unlink(tmpl);
+	pthread_atfork(NULL, NULL, rec_child);
+	writer_running = (pthread_create(&writer, NULL, writer_main, NULL) == 0);
+	busy = 0;
+}
+
+/****************************
+ * The finalizer
+ ****************************/
+
+/*
+ * Live blocks by address, open addressing with backward-shift delete.
+ * Also the blocks in the middle of a realloc, by link.
+ */
+#define NO_ID UINT32_MAX /* a block from before we were loaded */
+
+typedef struct
+{
+	uintptr_t addr; /* 0 if empty */
+	uint32_t id;
+	uint64_t size;
+} liveent_t;
+
+typedef struct
+{
+	liveent_t *slots;
+	uint64_t mask; /* slots - 1, a power of two less one */
+	uint64_t count;
+} livemap_t;
+
+#define LIVE_HASH(map, a) ((((uint64_t)(a) >> 4) * 0x9E3779B97F4A7C15ULL) >> 20 & (map)->mask)
+
+static void live_put(livemap_t *map, uintptr_t addr, uint32_t id, uint64_t size);
+
+static void live_grow(livemap_t *map)
+{
+	liveent_t *old = map->slots;
+	uint64_t i, n = map->mask + 1;
+
+	map->mask = 2 * n - 1;
+	map->count = 0;
+	if ((map->slots = __libc_calloc(2 * n, sizeof(liveent_t))) == NULL)
+	{
+		fprintf(stderr, "mmrecord: out of memory\n");
+		_exit(1);
+	}
+	for (i = 0; i < n; i++)
+		if (old[i].addr != 0)
+			live_put(map, old[i].addr, old[i].id, old[i].size);
+	__libc_free(old);
+}
+
+static liveent_t *live_find(livemap_t *map, uintptr_t addr)
+{
+	uint64_t i = LIVE_HASH(map, addr);
+
+	while (map->slots[i].addr != 0)
+	{
+		if (map->slots[i].addr == addr)
+			return &map->slots[i];
+		i = (i + 1) & map->mask;
+	}
+	return NULL;
+}
+
+static void live_put(livemap_t *map, uintptr_t addr, uint32_t id, uint64_t size)
+{
+	uint64_t i;
+
+	if (2 * (map->count + 1) > map->mask + 1)
+		live_grow(map);
+	i = LIVE_HASH(map, addr);
+	while (map->slots[i].addr != 0)
+		i = (i + 1) & map->mask;
+	map->slots[i].addr = addr;
+	map->slots[i].id = id;
+	map->slots[i].size = size;
+	map->count++;
+}
+
+static void live_del(livemap_t *map, liveent_t *e)
+{
+	uint64_t i = e - map->slots, j = i, home;
+
+	for (;;)
+	{
+		j = (j + 1) & map->mask;
+		if (map->slots[j].addr == 0)
+			break;
+		home = LIVE_HASH(map, map->slots[j].addr);
+		/* Move j into the hole at i unless its home lies in (i, j] */
+		if (((j - home) & map->mask) >= ((j - i) & map->mask))
+		{
+			map->slots[i] = map->slots[j];
+			i = j;
+		}
+	}
+	map->slots[i].addr = 0;
+	map->count--;
+}
+
+static int cmp_seq(const void *a, const void *b)
+{
+	uint64_t x = ((const recevent_t *)a)->seq, y = ((const recevent_t *)b)->seq;
+
+	return (x > y) - (x < y);
+}
+
+/* The trace being written by rec_write */
+typedef struct
+{
+	livemap_t live;	   /* the live blocks */
+	livemap_t moving;  /* ... but those in a realloc, by link */
+	FILE *ops;		/* the ops, to go after the header */
+	uint32_t ids;	/* ids handed out */
+	uint64_t num_ops;
+	uint64_t bytes; /* bytes live now ... */
+	uint64_t peak;	/* ... and at most */
+} rectrace_t;
+
+/* rec_free - Emit the free of live block l */
+static void rec_free(rectrace_t *tr, liveent_t *l)
+{
+	fprintf(tr->ops, "f %u\n", l->id);
+	tr->num_ops++;
+	tr->bytes -= l->size;
+	live_del(&tr->live, l);
+}
+
+/*
+ * rec_place - Enter block id of size bytes at addr.  A block we think
+ *     still live there was freed where we could not see it, so it is
+ *     freed first.
+ */
+static void rec_place(rectrace_t *tr, uintptr_t addr, uint32_t id, uint64_t size)
+{
+	liveent_t *l;
+
+	if ((l = live_find(&tr->live, addr)) != NULL)
+		rec_free(tr, l);
+	live_put(&tr->live, addr, id, size);
+	tr->bytes += size;
+	if (tr->bytes > tr->peak)
+		tr->peak = tr->bytes;
+}
+
+/*
+ * rec_write - Turn the sorted events into a balanced .rep trace.  The
+ *     ops go to a scratch file first, since the header needs their
+ *     count, then are copied after it.
+ */
+static void rec_write(recevent_t *ev, size_t n)
+{
+	rectrace_t tr;
+	liveent_t *l;
+	FILE *out;
+	uint64_t i, dropped = 0;
+	uint32_t id;
+	char line[64];
+
+	memset(&tr, 0, sizeof(tr));
+	tr.live.mask = tr.moving.mask = 1023;
+	if ((tr.live.slots = __libc_calloc(tr.live.mask + 1, sizeof(liveent_t))) == NULL ||
+		(tr.moving.slots = __libc_calloc(tr.moving.mask + 1, sizeof(liveent_t))) == NULL ||
+		(tr.ops = tmpfile()) == NULL)
+	{
+		fprintf(stderr, "mmrecord: cannot write the trace\n");
+		return;
+	}
+
+	for (i = 0; i < n; i++)
+		switch (ev[i].type)
+		{
+		case UNMAP:
+			/* Blocks from before we were loaded move as NO_ID */
+			if ((l = live_find(&tr.live, ev[i].ptr)) != NULL)
+			{
+				live_put(&tr.moving, ev[i].seq + 1, l->id, l->size);
+				live_del(&tr.live, l);
+			}
+			else
+				live_put(&tr.moving, ev[i].seq + 1, NO_ID, 0);
+			break;
+
+		case RESTORE:
+			if ((l = live_find(&tr.moving, ev[i].link)) == NULL)
+				break;
+			if (l->id != NO_ID)
+			{
+				tr.bytes -= l->size;
+				rec_place(&tr, ev[i].ptr, l->id, l->size);
+			}
+			live_del(&tr.moving, l);
+			break;
+
+		case REALLOC:
+			if ((l = live_find(&tr.moving, ev[i].link)) != NULL && l->id != NO_ID)
+			{
+				id = l->id;
+				fprintf(tr.ops, "r %u %llu\n", id, (unsigned long long)ev[i].size);
+				tr.num_ops++;
+				tr.bytes -= l->size;
+				live_del(&tr.moving, l);
+				rec_place(&tr, ev[i].ptr, id, ev[i].size);
+				break;
+			}
+			if (l != NULL)
+				live_del(&tr.moving, l);
+			/* Of a block from before we were loaded: a new block */
+			/* fall through */
+		case ALLOC:
+			fprintf(tr.ops, "a %u %llu\n", tr.ids, (unsigned long long)ev[i].size);
+			tr.num_ops++;
+			rec_place(&tr, ev[i].ptr, tr.ids++, ev[i].size);
+			break;
+
+		case FREE:
+			if ((l = live_find(&tr.live, ev[i].ptr)) != NULL)
+				rec_free(&tr, l);
+			else
+				dropped++;
+			break;
+		}
+
+	/* Balance the trace, as checktrace.pl does */
+	for (i = 0; i <= tr.live.mask; i++)
+		if (tr.live.slots[i].addr != 0)
+		{
+			fprintf(tr.ops, "f %u\n", tr.live.slots[i].id);
+			tr.num_ops++;
+		}
+	for (i = 0; i <= tr.moving.mask; i++)
+		if (tr.moving.slots[i].addr != 0 && tr.moving.slots[i].id != NO_ID)
+		{
+			fprintf(tr.ops, "f %u\n", tr.moving.slots[i].id);
+			tr.num_ops++;
+		}
+	__libc_free(tr.live.slots);
+	__libc_free(tr.moving.slots);
+
+	if ((out = fopen(out_path, "w")) == NULL)
+	{
+		fprintf(stderr, "mmrecord: cannot open %s: %s\n", out_path, strerror(errno));
+		fclose(tr.ops);
+		return;
+	}
+	/* The peak of live bytes stands in for the suggested heap size */
+	fprintf(out, "%llu\n%u\n%llu\n1\n",
+			(unsigned long long)((tr.peak > INT32_MAX) ? INT32_MAX : tr.peak),
+			tr.ids, (unsigned long long)tr.num_ops);
+	rewind(tr.ops);
+	while (fgets(line, sizeof(line), tr.ops) != NULL)
+		fputs(line, out);
+	fclose(tr.ops);
+	fclose(out);
+	if (dropped > 0)
+		fprintf(stderr, "mmrecord: dropped %llu frees of blocks allocated before recording\n",
+				(unsigned long long)dropped);
+}
+
+__attribute__((destructor)) static void rec_finish(void)
+{
+	thread_rec_t *t;
+	chunk_t *c;
+	struct stat st;
+	recevent_t *ev;
+
+	if (spill < 0 || !__atomic_load_n(&recording, __ATOMIC_RELAXED))
+		return;
+	busy = 1;
+	__atomic_store_n(&recording, 0, __ATOMIC_SEQ_CST);
+
+	/* Stop the writer, then write what it had not got to */
+	if (writer_running)
+	{
+		__atomic_store_n(&writer_stop, 1, __ATOMIC_RELEASE);
+		pthread_join(writer, NULL);
+	}
+	rec_flush(__atomic_exchange_n(&full, NULL, __ATOMIC_ACQUIRE));
+	for (t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); t != NULL; t = t->next)
+	{
+		while (__atomic_load_n(&t->logging, __ATOMIC_SEQ_CST))
+			sched_yield();
+		if ((c = t->chunk) != NULL)
+		{
+			t->chunk = NULL;
+			c->next = NULL;
+			rec_flush(c);
+		}
+	}
+
+	/* Put the calls of all threads back in order */
+	if (fstat(spill, &st) < 0)
+		return;
+	if (st.st_size == 0)
+		ev = NULL;
+	else if ((ev = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+						spill, 0)) == MAP_FAILED)
+	{
+		fprintf(stderr, "mmrecord: cannot map the spill file: %s\n", strerror(errno));
+		return;
+	}
+	qsort(ev, st.st_size / sizeof(recevent_t), sizeof(recevent_t), cmp_seq);
+	rec_write(ev, st.st_size / sizeof(recevent_t));
+	if (ev != NULL)
+		munmap(ev, st.st_size);
+	close(spill);
+	spill = -1;
+}
@@ -0,0 +1,141 @@
+/*
+ * perfctr.c - Hardware performance counters around a function
+ *
+ * The group belongs to the process that opened it: a forked child
+ * would count its parent, so perfctr_run opens a fresh group when it
+ * finds itself in a new process.  Counts are scaled up by the time the
+ * group was enabled over the time it ran, in case the kernel had to
+ * multiplex it with other users of the counters.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "perfctr.h"
+
+char *perfctr_names[PERFCTR_EVENTS] = {
+	"cycles", "instrs", "L1d-miss", "LLC-miss", "dTLB-miss", "br-miss"};
+
+#define CACHE_MISS(cache) \
+	((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+static struct
+{
+	uint32_t type;
+	uint64_t config;
+} events[PERFCTR_EVENTS] = {
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_L1D)},
+	{PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_LL)},
+	{PERF_TYPE_HW_CACHE, CACHE_MISS(PERF_COUNT_HW_CACHE_DTLB)},
+	{PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+};
+
+static int fds[PERFCTR_EVENTS]; /* fd of each event, or -1 */
+static int slot[PERFCTR_EVENTS]; /* its place in a group read, or -1 */
+static int nopen = 0;			 /* events in the group */
+static pid_t owner = 0;			 /* process the group counts */
+static int open_errno = 0;		 /* why the group could not be opened */
+
+static int open_event(int e, int group)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = events[e].type;
+	attr.config = events[e].config;
+	attr.disabled = (group < 0); /* the leader starts and stops them all */
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+					   PERF_FORMAT_TOTAL_TIME_RUNNING;
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+
+/*
+ * perfctr_open - Open the group in this process, led by the cycle
+ *     counter.  Returns 0, or -1 if cycles cannot be counted.
+ */
+int perfctr_open(void)
+{
+	int e;
+
+	perfctr_close();
+	if ((fds[0] = open_event(PERFCTR_CYCLES, -1)) < 0)
+	{
+		open_errno = errno;
+		return -1;
+	}
+	slot[0] = 0;
+	nopen = 1;
+	for (e = 1; e < PERFCTR_EVENTS; e++)
+	{
+		fds[e] = open_event(e, fds[0]);
+		slot[e] = (fds[e] < 0) ? -1 : nopen++;
+	}
+	owner = getpid();
+	return 0;
+}
+
+/*
+ * perfctr_run - Run f(argp) once with the counters on and store the
+ *     count of each event in counts, or -1 for those not counted.
+ *     Returns 0, or -1 if there are no counters.
+ */
+int perfctr_run(void (*f)(void *), void *argp, double *counts)
+{
+	uint64_t buf[3 + PERFCTR_EVENTS]; /* nr, enabled, running, values */
+	double scale;
+	int e;
+
+	if (owner != getpid() && perfctr_open() < 0)
+		return -1;
+
+	ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+	ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	f(argp);
+	ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+	if (read(fds[0], buf, sizeof(buf)) < (ssize_t)(3 * sizeof(uint64_t)) ||
+		buf[0] != (uint64_t)nopen || buf[2] == 0)
+	{
+		/* The group never got onto the PMU */
+		open_errno = EBUSY;
+		return -1;
+	}
+	scale = (double)buf[1] / buf[2];
+	for (e = 0; e < PERFCTR_EVENTS; e++)
+		counts[e] = (slot[e] < 0) ? -1 : buf[3 + slot[e]] * scale;
+	return 0;
+}
+
+/*
+ * perfctr_error - Why there are no counters
+ */
+char *perfctr_error(void)
+{
+	if (open_errno == EACCES || open_errno == EPERM)
+		return "not permitted, see /proc/sys/kernel/perf_event_paranoid";
+	if (open_errno == ENOENT || open_errno == ENODEV || open_errno == ENOSYS)
+		return "no hardware counters on this machine";
+	return strerror(open_errno);
+}
+
+void perfctr_close(void)
+{
+	int e;
+
+	for (e = 0; e < PERFCTR_EVENTS && owner != 0; e++)
+		if (fds[e] >= 0)
+			close(fds[e]);
+	nopen = 0;
+	owner = 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * perfctr.h - Hardware performance counters around a function
+ *
+ * The events are counted in one perf_event_open group, in user mode
+ * only, so they all cover the same instructions.  Events the CPU or
+ * kernel does not offer are left out of the group.  If even cycles
+ * cannot be counted (no PMU, or perf_event_paranoid forbids it),
+ * perfctr_run fails and the caller carries on with timing alone.
+ */
+
+/* The events, in the order of perfctr_names */
+#define PERFCTR_CYCLES 0
+#define PERFCTR_INSTRUCTIONS 1
+#define PERFCTR_L1D_MISSES 2
+#define PERFCTR_LLC_MISSES 3
+#define PERFCTR_DTLB_MISSES 4
+#define PERFCTR_BRANCH_MISSES 5
+#define PERFCTR_EVENTS 6
+
+extern char *perfctr_names[PERFCTR_EVENTS];
+
+int perfctr_open(void);
+int perfctr_run(void (*f)(void *), void *argp, double *counts);
+char *perfctr_error(void);
+void perfctr_close(void);
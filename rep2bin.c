@@ -0,0 +1,54 @@
+/*
+ * rep2bin.c - Convert a malloc trace to the binary trace format
+ *
+ * usage: rep2bin [-z] <in> <out>
+ *
+ * The input may be a text .rep trace or a binary trace.  Without -z the
+ * output is an array of traceop_t that mdriver maps and replays in
+ * place; with -z the ops are varint/delta packed, which is several
+ * times smaller but is decoded when loaded.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "trace.h"
+
+static void usage(void)
+{
+	fprintf(stderr, "Usage: rep2bin [-z] <in> <out>\n");
+	fprintf(stderr, "\t-z  Pack the ops with varint/delta coding.\n");
+}
+
+int main(int argc, char **argv)
+{
+	trace_t *trace;
+	int flags = 0;
+	int c;
+
+	while ((c = getopt(argc, argv, "zh")) != EOF)
+	{
+		switch (c)
+		{
+		case 'z':
+			flags |= TRACE_PACKED;
+			break;
+		case 'h':
+			usage();
+			exit(0);
+		default:
+			usage();
+			exit(1);
+		}
+	}
+	if (argc - optind != 2)
+	{
+		usage();
+		exit(1);
+	}
+
+	trace = read_trace("", argv[optind]);
+	write_trace(trace, argv[optind + 1], flags);
+	free_trace(trace);
+	exit(0);
+}
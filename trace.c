@@ -0,0 +1,560 @@
+/*
+ * trace.c - Reading and writing malloc trace files
+ *
+ * Text traces are parsed with fscanf into a malloc'd op array.  An
+ * unpacked binary trace is mmap'd and its op array used where it lies,
+ * so loading it costs one pass to check the indices and nothing else.
+ * A packed binary trace is decoded from the mapping into a malloc'd
+ * array, which is still far cheaper than parsing text.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+
+#include "trace.h"
+
+#define MAXLINE 1024 /* max string size */
+
+static trace_t *read_text_trace(FILE *tracefile, trace_t *trace, char *path);
+static trace_t *read_binary_trace(int fd, trace_t *trace, char *path);
+static int parse_text_op(FILE *tracefile, traceop_t *op, char *path);
+static void trace_error(char *msg, char *path);
+static void format_error(char *msg, char *path);
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+trace_t *read_trace(char *tracedir, char *filename)
+{
+	FILE *tracefile;
+	trace_t *trace;
+	char path[MAXLINE];
+	char magic[sizeof(TRACE_MAGIC)];
+
+	/* Allocate the trace record */
+	if ((trace = (trace_t *)malloc(sizeof(trace_t))) == NULL)
+		trace_error("malloc 1 failed in read_trace", NULL);
+	trace->map = NULL;
+	trace->map_len = 0;
+
+	/* Binary traces start with TRACE_MAGIC, text traces with a number */
+	strcpy(path, tracedir);
+	strcat(path, filename);
+	if ((tracefile = fopen(path, "r")) == NULL)
+		trace_error("Could not open trace", path);
+	if (fread(magic, 1, sizeof(magic), tracefile) == sizeof(magic) &&
+		memcmp(magic, TRACE_MAGIC, sizeof(magic)) == 0)
+	{
+		trace = read_binary_trace(fileno(tracefile), trace, path);
+		fclose(tracefile);
+		return trace;
+	}
+	rewind(tracefile);
+	trace = read_text_trace(tracefile, trace, path);
+	fclose(tracefile);
+	return trace;
+}
+
+/*
+ * read_text_trace - parse a .rep trace
+ */
+static trace_t *read_text_trace(FILE *tracefile, trace_t *trace, char *path)
+{
+	unsigned max_index = 0;
+	unsigned op_index;
+
+	/* Read the trace file header */
+	fscanf(tracefile, "%d", &(trace->sugg_heapsize)); /* not used */
+	fscanf(tracefile, "%d", &(trace->num_ids));
+	fscanf(tracefile, "%d", &(trace->num_ops));
+	fscanf(tracefile, "%d", &(trace->weight)); /* not used */
+
+	/* We'll store each request line in the trace in this array */
+	if ((trace->ops =
+			 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+		trace_error("malloc 2 failed in read_trace", NULL);
+
+	/* We'll keep an array of pointers to the allocated blocks here... */
+	if ((trace->blocks =
+			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+		trace_error("malloc 3 failed in read_trace", NULL);
+
+	/* ... along with the corresponding byte sizes of each block */
+	if ((trace->block_sizes =
+			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+		trace_error("malloc 4 failed in read_trace", NULL);
+
+	/* read every request line in the trace file */
+	op_index = 0;
+	while (op_index < trace->num_ops &&
+		   parse_text_op(tracefile, &trace->ops[op_index], path))
+	{
+		if (trace->ops[op_index].type != FREE &&
+			trace->ops[op_index].index > max_index)
+			max_index = trace->ops[op_index].index;
+		op_index++;
+	}
+	assert(max_index == trace->num_ids - 1);
+	assert(trace->num_ops == op_index);
+
+	return trace;
+}
+
+/*
+ * parse_text_op - parse the next request line of a .rep trace into op,
+ *     return 0 at the end of the file
+ */
+static int parse_text_op(FILE *tracefile, traceop_t *op, char *path)
+{
+	char type[MAXLINE];
+	unsigned index = 0;
+	size_t size = 0;
+
+	if (fscanf(tracefile, "%s", type) == EOF)
+		return 0;
+	switch (type[0])
+	{
+	case 'a':
+		fscanf(tracefile, "%u %zu", &index, &size);
+		op->type = ALLOC;
+		break;
+	case 'r':
+		fscanf(tracefile, "%u %zu", &index, &size);
+		op->type = REALLOC;
+		break;
+	case 'f':
+		fscanf(tracefile, "%ud", &index);
+		op->type = FREE;
+		break;
+	default:
+		printf("Bogus type character (%c) in tracefile %s\n",
+			   type[0], path);
+		exit(1);
+	}
+	op->index = index;
+	op->size = size;
+	return 1;
+}
+
+/*
+ * get_varint - Decode the LEB128 varint at *pp, advancing *pp past it.
+ *     Returns 0 if it runs past end.
+ */
+static int get_varint(unsigned char **pp, unsigned char *end, uint64_t *val)
+{
+	unsigned char *p = *pp;
+	uint64_t v = 0;
+	int shift = 0;
+
+	do
+	{
+		if (p >= end || shift > 63)
+			return 0;
+		v |= (uint64_t)(*p & 0x7f) << shift;
+		shift += 7;
+	} while (*p++ & 0x80);
+	*val = v;
+	*pp = p;
+	return 1;
+}
+
+/*
+ * read_binary_trace - map a binary trace written by write_trace
+ */
+static trace_t *read_binary_trace(int fd, trace_t *trace, char *path)
+{
+	struct stat st;
+	tracehdr_t *hdr;
+	unsigned char *p, *end;
+	uint64_t v, size;
+	uint32_t index = 0;
+	int i;
+
+	if (fstat(fd, &st) < 0)
+		trace_error("Could not stat trace", path);
+	if ((size_t)st.st_size < sizeof(tracehdr_t))
+		format_error("Truncated binary trace", path);
+	trace->map_len = st.st_size;
+	trace->map = mmap(NULL, trace->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (trace->map == MAP_FAILED)
+		trace_error("Could not map trace", path);
+
+	hdr = (tracehdr_t *)trace->map;
+	if (hdr->version != TRACE_VERSION)
+		format_error("Unknown binary trace version", path);
+	if (hdr->num_ids <= 0 || hdr->num_ops < 0 ||
+		hdr->ops_len > trace->map_len - sizeof(tracehdr_t))
+		format_error("Bad binary trace header", path);
+	trace->sugg_heapsize = hdr->sugg_heapsize;
+	trace->num_ids = hdr->num_ids;
+	trace->num_ops = hdr->num_ops;
+	trace->weight = hdr->weight;
+	p = (unsigned char *)(hdr + 1);
+	end = p + hdr->ops_len;
+
+	if ((trace->blocks =
+			 (char **)malloc(trace->num_ids * sizeof(char *))) == NULL)
+		trace_error("malloc 3 failed in read_trace", NULL);
+	if ((trace->block_sizes =
+			 (size_t *)malloc(trace->num_ids * sizeof(size_t))) == NULL)
+		trace_error("malloc 4 failed in read_trace", NULL);
+
+	if (!(hdr->flags & TRACE_PACKED))
+	{
+		/* The ops are used in place; just make sure they are sane */
+		if (hdr->ops_len != (uint64_t)trace->num_ops * sizeof(traceop_t))
+			format_error("Bad binary trace header", path);
+		madvise(trace->map, trace->map_len, MADV_WILLNEED);
+		trace->ops = (traceop_t *)p;
+		for (i = 0; i < trace->num_ops; i++)
+			if (trace->ops[i].type > REALLOC ||
+				trace->ops[i].index >= (uint32_t)trace->num_ids)
+				format_error("Bad op in binary trace", path);
+		return trace;
+	}
+
+	/* Packed ops are decoded into a private array */
+	if ((trace->ops =
+			 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+		trace_error("malloc 2 failed in read_trace", NULL);
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		if (!get_varint(&p, end, &v))
+			format_error("Truncated binary trace", path);
+		trace->ops[i].type = v & 0x3;
+		v >>= 2;
+		index += (v & 1) ? ~(uint32_t)(v >> 1) : (uint32_t)(v >> 1);
+		trace->ops[i].index = index;
+		size = 0;
+		if (trace->ops[i].type != FREE && !get_varint(&p, end, &size))
+			format_error("Truncated binary trace", path);
+		trace->ops[i].size = size;
+		if (trace->ops[i].type > REALLOC || index >= (uint32_t)trace->num_ids)
+			format_error("Bad op in binary trace", path);
+	}
+	munmap(trace->map, trace->map_len);
+	trace->map = NULL;
+	trace->map_len = 0;
+	return trace;
+}
+
+/*
+ * put_varint - Append v to f as a LEB128 varint, return its length.
+ *     With f NULL only the length is computed.
+ */
+static size_t put_varint(FILE *f, uint64_t v)
+{
+	size_t n = 1;
+
+	while (v >= 0x80)
+	{
+		if (f != NULL)
+			putc((int)(v & 0x7f) | 0x80, f);
+		v >>= 7;
+		n++;
+	}
+	if (f != NULL)
+		putc((int)v, f);
+	return n;
+}
+
+/*
+ * put_ops - Write the ops of trace to f packed, return their length.
+ *     With f NULL only the length is computed.
+ */
+static uint64_t put_ops(FILE *f, trace_t *trace)
+{
+	uint64_t len = 0;
+	uint32_t index = 0;
+	uint32_t zigzag;
+	int32_t delta;
+	int i;
+
+	for (i = 0; i < trace->num_ops; i++)
+	{
+		delta = (int32_t)(trace->ops[i].index - index);
+		index = trace->ops[i].index;
+		zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+		len += put_varint(f, ((uint64_t)zigzag << 2) | trace->ops[i].type);
+		if (trace->ops[i].type != FREE)
+			len += put_varint(f, trace->ops[i].size);
+	}
+	return len;
+}
+
+/*
+ * write_trace - write a trace to path in the binary format, packed if
+ *     flags has TRACE_PACKED
+ */
+void write_trace(trace_t *trace, char *path, int flags)
+{
+	FILE *f;
+	tracehdr_t hdr;
+
+	if ((f = fopen(path, "wb")) == NULL)
+		trace_error("Could not create trace", path);
+
+	memset(&hdr, 0, sizeof(hdr));
+	strcpy(hdr.magic, TRACE_MAGIC);
+	hdr.version = TRACE_VERSION;
+	hdr.flags = flags;
+	hdr.sugg_heapsize = trace->sugg_heapsize;
+	hdr.num_ids = trace->num_ids;
+	hdr.num_ops = trace->num_ops;
+	hdr.weight = trace->weight;
+	if (flags & TRACE_PACKED)
+		hdr.ops_len = put_ops(NULL, trace);
+	else
+		hdr.ops_len = (uint64_t)trace->num_ops * sizeof(traceop_t);
+	fwrite(&hdr, sizeof(hdr), 1, f);
+
+	if (flags & TRACE_PACKED)
+		put_ops(f, trace);
+	else
+		fwrite(trace->ops, sizeof(traceop_t), trace->num_ops, f);
+	if (ferror(f) | fclose(f))
+		trace_error("Could not write trace", path);
+}
+
+/*
+ * free_trace - Free the trace record and the three arrays it points
+ *              to, all of which were allocated in read_trace().
+ */
+void free_trace(trace_t *trace)
+{
+	if (trace->map != NULL)
+		munmap(trace->map, trace->map_len); /* the ops live in the mapping */
+	else
+		free(trace->ops); /* free the three arrays... */
+	free(trace->blocks);
+	free(trace->block_sizes);
+	free(trace); /* and the trace record itself... */
+}
+
+/*
+ * fget_varint - Read a LEB128 varint from f, return 0 at the end of f
+ */
+static int fget_varint(FILE *f, uint64_t *val)
+{
+	uint64_t v = 0;
+	int shift = 0;
+	int c;
+
+	do
+	{
+		if ((c = getc_unlocked(f)) == EOF || shift > 63)
+			return 0;
+		v |= (uint64_t)(c & 0x7f) << shift;
+		shift += 7;
+	} while (c & 0x80);
+	*val = v;
+	return 1;
+}
+
+/*
+ * fill_chunk - Read the next ops of stream s into buf, return how many
+ */
+static int fill_chunk(tstream_t *s, traceop_t *buf)
+{
+	int n = (s->left < TRACE_CHUNK) ? s->left : TRACE_CHUNK;
+	uint64_t v, size;
+	int i;
+
+	if (s->flags & TRACE_TEXT)
+	{
+		for (i = 0; i < n; i++)
+			if (!parse_text_op(s->file, &buf[i], s->path))
+				format_error("Truncated trace", s->path);
+	}
+	else if (s->flags & TRACE_PACKED)
+	{
+		for (i = 0; i < n; i++)
+		{
+			if (!fget_varint(s->file, &v))
+				format_error("Truncated binary trace", s->path);
+			buf[i].type = v & 0x3;
+			v >>= 2;
+			s->index += (v & 1) ? ~(uint32_t)(v >> 1) : (uint32_t)(v >> 1);
+			buf[i].index = s->index;
+			size = 0;
+			if (buf[i].type != FREE && !fget_varint(s->file, &size))
+				format_error("Truncated binary trace", s->path);
+			if (buf[i].type > REALLOC)
+				format_error("Bad op in binary trace", s->path);
+			buf[i].size = size;
+		}
+	}
+	else
+	{
+		if (fread(buf, sizeof(traceop_t), n, s->file) != (size_t)n)
+			format_error("Truncated binary trace", s->path);
+		for (i = 0; i < n; i++)
+			if (buf[i].type > REALLOC)
+				format_error("Bad op in binary trace", s->path);
+	}
+	s->left -= n;
+	return n;
+}
+
+/*
+ * stream_reader - The reader thread of a stream: fill whichever buffer
+ *     the caller has given back, until the trace runs out.  A chunk of
+ *     0 ops marks the end.
+ */
+static void *stream_reader(void *arg)
+{
+	tstream_t *s = (tstream_t *)arg;
+	int w = 0;
+	int n, done;
+
+	for (;;)
+	{
+		pthread_mutex_lock(&s->lock);
+		while (s->full[w] && !s->done)
+			pthread_cond_wait(&s->cond, &s->lock);
+		done = s->done;
+		pthread_mutex_unlock(&s->lock);
+		if (done)
+			break;
+
+		n = fill_chunk(s, s->buf[w]);
+
+		pthread_mutex_lock(&s->lock);
+		s->count[w] = n;
+		s->full[w] = 1;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->lock);
+		if (n == 0)
+			break;
+		w ^= 1;
+	}
+	return NULL;
+}
+
+/*
+ * open_trace_stream - Open a trace for replay a chunk at a time and
+ *     start reading its first chunk
+ */
+tstream_t *open_trace_stream(char *tracedir, char *filename)
+{
+	tstream_t *s;
+	tracehdr_t hdr;
+	char path[MAXLINE];
+
+	if ((s = (tstream_t *)calloc(1, sizeof(tstream_t))) == NULL)
+		trace_error("calloc failed in open_trace_stream", NULL);
+	strcpy(path, tracedir);
+	strcat(path, filename);
+	if ((s->path = strdup(path)) == NULL)
+		trace_error("strdup failed in open_trace_stream", NULL);
+	if ((s->file = fopen(path, "r")) == NULL)
+		trace_error("Could not open trace", path);
+
+	if (fread(&hdr, sizeof(hdr), 1, s->file) == 1 &&
+		memcmp(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic)) == 0)
+	{
+		if (hdr.version != TRACE_VERSION)
+			format_error("Unknown binary trace version", path);
+		s->sugg_heapsize = hdr.sugg_heapsize;
+		s->num_ids = hdr.num_ids;
+		s->num_ops = hdr.num_ops;
+		s->weight = hdr.weight;
+		s->flags = hdr.flags & TRACE_PACKED;
+	}
+	else
+	{
+		rewind(s->file);
+		if (fscanf(s->file, "%d %d %d %d", &s->sugg_heapsize, &s->num_ids,
+				   &s->num_ops, &s->weight) != 4)
+			format_error("Bad trace header", path);
+		s->flags = TRACE_TEXT;
+	}
+	if (s->num_ops < 0)
+		format_error("Bad trace header", path);
+	s->left = s->num_ops;
+
+	if ((s->buf[0] = malloc(2 * TRACE_CHUNK * sizeof(traceop_t))) == NULL)
+		trace_error("malloc failed in open_trace_stream", NULL);
+	s->buf[1] = s->buf[0] + TRACE_CHUNK;
+	pthread_mutex_init(&s->lock, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	if ((errno = pthread_create(&s->reader, NULL, stream_reader, s)) != 0)
+		trace_error("pthread_create failed in open_trace_stream", NULL);
+	return s;
+}
+
+/*
+ * trace_stream_next - Hand back the chunk the caller was replaying and
+ *     get the next one.  Sets *ops to the chunk, which stays valid until
+ *     the next call, and returns its length: 0 at the end of the trace.
+ */
+int trace_stream_next(tstream_t *s, traceop_t **ops)
+{
+	int n;
+
+	pthread_mutex_lock(&s->lock);
+	if (s->held)
+	{
+		s->full[s->next ^ 1] = 0;
+		s->held = 0;
+		pthread_cond_broadcast(&s->cond);
+	}
+	while (!s->full[s->next])
+		pthread_cond_wait(&s->cond, &s->lock);
+	n = s->count[s->next];
+	*ops = s->buf[s->next];
+	if (n > 0)
+	{
+		s->held = 1;
+		s->next ^= 1;
+	}
+	pthread_mutex_unlock(&s->lock);
+	return n;
+}
+
+/*
+ * close_trace_stream - Stop the reader and free the stream
+ */
+void close_trace_stream(tstream_t *s)
+{
+	pthread_mutex_lock(&s->lock);
+	s->done = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->lock);
+	pthread_join(s->reader, NULL);
+
+	pthread_mutex_destroy(&s->lock);
+	pthread_cond_destroy(&s->cond);
+	fclose(s->file);
+	free(s->buf[0]);
+	free(s->path);
+	free(s);
+}
+
+/*
+ * trace_error - Report a failure on a trace file and exit
+ */
+static void trace_error(char *msg, char *path)
+{
+	if (path != NULL)
+		printf("%s %s: %s\n", msg, path, strerror(errno));
+	else
+		printf("%s: %s\n", msg, strerror(errno));
+	exit(1);
+}
+
+/*
+ * format_error - Report a malformed binary trace and exit
+ */
+static void format_error(char *msg, char *path)
+{
+	printf("%s %s\n", msg, path);
+	exit(1);
+}
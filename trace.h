@@ -0,0 +1,105 @@
+/*
+ * trace.h - Reading and writing malloc trace files
+ *
+ * A trace is either the text format of the shipped .rep files or the
+ * binary format written by rep2bin.  read_trace tells them apart by the
+ * magic number at the start of a binary file.
+ */
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <pthread.h>
+
+/* Types of trace operations */
+#define ALLOC 0
+#define FREE 1
+#define REALLOC 2
+
+/*
+ * Characterizes a single trace operation (allocator request).  The
+ * layout is fixed because it is also the on-disk layout of an unpacked
+ * binary trace, which is used in place.
+ */
+typedef struct
+{
+	uint32_t type;	/* type of request */
+	uint32_t index; /* index for free() to use later */
+	uint64_t size;	/* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file*/
+typedef struct
+{
+	int sugg_heapsize;	 /* suggested heap size (unused) */
+	int num_ids;		 /* number of alloc/realloc ids */
+	int num_ops;		 /* number of distinct requests */
+	int weight;			 /* weight for this trace (unused) */
+	traceop_t *ops;		 /* array of requests */
+	char **blocks;		 /* array of ptrs returned by malloc/realloc... */
+	size_t *block_sizes; /* ... and a corresponding array of payload sizes */
+	void *map;			 /* mapping of a binary trace file, or NULL */
+	size_t map_len;		 /* ... and its length */
+} trace_t;
+
+/*
+ * Binary trace file header.  The ops follow it, either as an array of
+ * traceop_t or, with TRACE_PACKED, as a stream of varints: for each op
+ * the zigzag-coded change of index since the previous op shifted left
+ * by 2 with the type in the low bits, then for ALLOC and REALLOC the
+ * size.  Fields are in host byte order.
+ */
+#define TRACE_MAGIC "MMTRACE"
+#define TRACE_VERSION 1
+#define TRACE_PACKED 0x1
+
+typedef struct
+{
+	char magic[8];		 /* TRACE_MAGIC, NUL-terminated */
+	uint32_t version;	 /* TRACE_VERSION */
+	uint32_t flags;		 /* TRACE_PACKED or 0 */
+	int32_t sugg_heapsize;
+	int32_t num_ids;
+	int32_t num_ops;
+	int32_t weight;
+	uint64_t ops_len;	 /* bytes of op data after the header */
+} tracehdr_t;
+
+/* Ops in each of a stream's two buffers */
+#define TRACE_CHUNK (1 << 16)
+
+/*
+ * A trace read TRACE_CHUNK ops at a time, for traces too large to hold
+ * in memory.  A reader thread fills one buffer while the caller replays
+ * the other.  Only the header fields are meant for the caller.
+ */
+typedef struct
+{
+	int sugg_heapsize; /* the trace header, as in trace_t */
+	int num_ids;
+	int num_ops;
+	int weight;
+
+	FILE *file;			   /* the trace, positioned at the next op */
+	char *path;			   /* ... and its name, for error messages */
+	uint32_t flags;		   /* 0, TRACE_PACKED, or TRACE_TEXT */
+	int left;			   /* ops not yet read */
+	uint32_t index;		   /* index of the last op read (packed) */
+	traceop_t *buf[2];	   /* the two buffers */
+	int count[2];		   /* ops in each buffer, once full */
+	int full[2];		   /* buffer waits for the caller */
+	int next;			   /* buffer the caller gets next */
+	int held;			   /* caller is replaying the other buffer */
+	int done;			   /* caller is closing the stream */
+	pthread_t reader;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} tstream_t;
+#define TRACE_TEXT 0x80000000 /* tstream_t flag: not a binary trace */
+
+trace_t *read_trace(char *tracedir, char *filename);
+void write_trace(trace_t *trace, char *path, int flags);
+void free_trace(trace_t *trace);
+
+tstream_t *open_trace_stream(char *tracedir, char *filename);
+int trace_stream_next(tstream_t *s, traceop_t **ops);
+void close_trace_stream(tstream_t *s);